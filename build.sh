@@ -21,6 +21,9 @@ popd > /dev/null
 # Linux compilation
 gcc $DEBUG_FLAGS $COMMON_CFLAGS $SHARED_FLAGS $FPIC_FLAGS -o "$LINUX_OUT" selector.c
 
+# Replayer benchmark, stays here (./pt2bench [module.mod] [rate] [runs] [min x realtime] [out.wav])
+gcc $COMMON_CFLAGS -o pt2bench pt2bench.c -lm
+
 # Windows compilation
 x86_64-w64-mingw32-gcc $COMMON_CFLAGS $SHARED_FLAGS -o "$WINDOWS_OUT" selector.c
 
@@ -3,12 +3,28 @@
  * 2021-03-30
  * NOTE(peter): Modified in several ways
  *              - Now takes a state, so that we can have several songs and easily switch between them
- *              - All memory handling removed, we handle the memory ourself. We statically allocate the
- *                memory for mixbuffers and such.
+ *              - All memory handling removed, we handle the memory ourself. The mixbuffer and BPM table
+ *                are part of the state, so several players can be mixed at the same time from different
+ *                threads. pt2play_initPlayer() sets up the shared read-only tables and has to be called
+ *                before that, further calls leave them alone.
+ *              - pt2play_RenderToBuffer() and pt2play_RenderToWAV() render a whole song offline, stopping
+ *                when it loops. pt2bench.c uses them to measure the replayer speed.
+ *              - The module data is never written to, so it can be read-only and shared by several players.
+ *                pt2play_PlaySong() allocates the decoded patterns and copies of the samples that the
+ *                replayer writes to (EFx), pt2play_Close() frees them.
  *              - Removed songname stuff as well.
- *
- * TODO(peter): Add so that we know when a new "note" has been played on a channel, so that we
- *              can make "equalizers" in remakes.
+ *              - state->channelInfo[] tells what each channel is doing: when the last note was triggered
+ *                (in mixed samples), the sample, volume and period, and the peak/RMS level of the last
+ *                pt2play_FillAudioBuffer() call. Made for "equalizers" in remakes.
+ *              - The resampling is picked at runtime with pt2play_SetInterpolation(): nearest, linear,
+ *                BLEP (the original sound) or windowed sinc. pt2bench.c reports the cost of each.
+ *              - pt2play_FillAudioBuffer() can write float32 or int32 instead of int16, see
+ *                pt2play_SetOutputFormat(). The dither is a hash of the sample position instead of an
+ *                LCG, so a block of it can be made at once.
+ *              - pt2play_Seek() starts the song at any row, from checkpoints of the replayer state that
+ *                are made by running the song with ticks only, without mixing.
+ *              - pt2play_Analyze() gives the length of the song and a timeline of its notes and effects
+ *                per channel, from the ticks only, without mixing.
  *
  */
 
@@ -124,6 +140,7 @@ uint32_t pt2play_GetMixerTicks(void); // returns the amount of milliseconds of m
 #define USE_BLEP				/* --> Reduces some aliasing in the sound (closer to real Amiga) - comment out for a speed-up */
 //#define ENABLE_E8_EFFECT	/* --> Enable E8x (Karplus-Strong) - comment out this line if E8x is used for something else */
 #define LED_FILTER			/* --> Process the Amiga "LED" filter - comment out to disable */
+//#define USE_FIXEDPOINT		/* --> Integer-only Paula mixer and filters, for machines with slow floating point (see "FIXED-POINT MIXER") */
 #define MIX_BUF_SAMPLES 4096
 
 #include <stdio.h>
@@ -132,12 +149,49 @@ uint32_t pt2play_GetMixerTicks(void); // returns the amount of milliseconds of m
 #include <stdint.h>
 #include <stdbool.h>
 #include <math.h> // tan()
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h> // SSE2/AVX2 mixer kernels
+#define MIX_SIMD_X86
+#endif
+
+/* Define PT2PLAY_TIMER() before including this file to have pt2play_FillAudioBuffer() add up the
+** time spent in tickReplayer() and mixAudio() in tickTime/mixTime of the state. It has to return
+** a uint64_t time stamp, the unit is up to the caller.
+*/
+#ifndef PT2PLAY_TIMER
+#define PT2PLAY_TIMER() 0
+#endif
 
 enum {
 	CIA_TEMPO_MODE = 0,
 	VBLANK_TEMPO_MODE = 1
 };
 
+/* Resampling of the Paula voices, see pt2play_SetInterpolation(). Linear and sinc lag one and four
+** Paula samples behind the other two, as they interpolate over the samples already fetched.
+*/
+enum {
+	INTERPOLATION_NEAREST = 0, // sample-and-hold like Paula, with all of its aliasing
+	INTERPOLATION_LINEAR = 1,
+	INTERPOLATION_BLEP = 2, // sample-and-hold with band-limited steps, the closest to a real Amiga (needs USE_BLEP)
+	INTERPOLATION_SINC = 3, // 8-tap windowed sinc, the cleanest and the slowest, meant for offline rendering
+	INTERPOLATION_COUNT
+};
+
+#ifdef USE_BLEP
+#define DEFAULT_INTERPOLATION INTERPOLATION_BLEP
+#else
+#define DEFAULT_INTERPOLATION INTERPOLATION_NEAREST
+#endif
+
+// sample format of pt2play_FillAudioBuffer(), interleaved stereo in all of them
+enum {
+	OUTPUT_INT16 = 0, // dithered, the default
+	OUTPUT_INT32 = 1, // the int16 scale in 16.16, not dithered
+	OUTPUT_FLOAT32 = 2, // the int16 scale in -1.0..1.0, not dithered and not clipped
+	OUTPUT_FORMAT_COUNT
+};
+
 // main crystal oscillator
 #define AMIGA_PAL_XTAL_HZ 28375160
 
@@ -147,7 +201,7 @@ enum {
 #define MAX_SAMPLE_LEN (0xFFFF*2)
 #define AMIGA_VOICES 4
 
-#define INITIAL_DITHER_SEED 0x12345000
+#define DITHER_SEED 0x12345000
 
 // do not change these!
 #ifdef USE_BLEP
@@ -159,65 +213,148 @@ enum {
 #define BLEP_RNS 31
 #endif
 
+#ifndef USE_FIXEDPOINT
+#define SINC_TAPS 8 // a power of two, for the history ring
+#define SINC_PHASES 256
+#endif
+
 #ifdef USE_BLEP
 typedef struct blep_t {
 	int32_t index, samplesLeft;
+#ifdef USE_FIXEDPOINT
+	int32_t buffer[BLEP_RNS + 1], lastValue; // Q16
+#else
 	double dBuffer[BLEP_RNS + 1], dLastValue;
+#endif
 } blep_t;
 #endif
 
 typedef struct ptChannel_t {
-	int8_t *n_start, *n_wavestart, *n_loopstart, n_chanindex, n_volume;
+	const int8_t *n_start, *n_wavestart, *n_loopstart;
+	int8_t n_chanindex, n_volume;
 	int8_t n_toneportdirec, n_pattpos, n_loopcount;
 	uint8_t n_wavecontrol, n_glissfunk, n_sampleoffset, n_toneportspeed;
 	uint8_t n_vibratocmd, n_tremolocmd, n_finetune, n_funkoffset;
 	uint8_t n_vibratopos, n_tremolopos;
+	uint8_t n_noteindex, n_samplenum;
 	int16_t n_period, n_note, n_wantedperiod;
 	uint16_t n_cmd, n_length, n_replen;
 } ptChannel_t;
 
 typedef struct paulaVoice_t {
-	volatile bool active;
+	bool active; // like the rest of the state, only touched by the thread running the replayer
 	const int8_t *data, *newData;
 	int32_t length, newLength, pos;
+#ifdef USE_FIXEDPOINT
+	uint32_t phase, delta; // 32.32 phase accumulator, pos is the integer part
+	int32_t volume, panL, panR; // Q16
+#ifdef USE_BLEP
+	uint32_t deltaMul, lastDelta, lastPhase, lastDeltaMul; // deltaMul is 2^52 / delta
+#endif
+#else
 	double dVolume, dDelta, dPhase, dPanL, dPanR;
 #ifdef USE_BLEP
 	double dDeltaMul, dLastDelta, dLastPhase, dLastDeltaMul;
+#endif
+	double dHistory[SINC_TAPS * 2]; // the last SINC_TAPS samples fetched, stored twice so they can be read in one piece
+	int32_t historyIndex; // the newest is dHistory[historyIndex + SINC_TAPS]
+#endif
+#ifdef USE_FIXEDPOINT
+	int32_t meterPeak; // Q16
+	uint64_t meterSumSq; // Q32
+#else
+	double dMeterPeak, dMeterSumSq;
 #endif
 } paulaVoice_t;
 
+// what a channel is doing, updated by the replayer and the mixer
+typedef struct channelInfo_t {
+	uint64_t triggerPos; // samplePos of the last note, retrigger or note delay
+	uint32_t triggerCount; // one up for every trigger, so two triggers between two reads aren't lost
+	uint8_t sample; // 1..31, 0 before the first note
+	uint8_t volume; // 0..64, as set in Paula (tremolo included)
+	uint16_t period; // as set in Paula (vibrato and arpeggio included)
+	float peak, rms; // 0..1, of the last pt2play_FillAudioBuffer() call
+} channelInfo_t;
+
 #if defined(USE_HIGHPASS) || defined(USE_LOWPASS)
 typedef struct rcFilter_t {
+#ifdef USE_FIXEDPOINT
+	int64_t buffer[2]; // Q24
+	int64_t c2, g, cg; // Q30
+#else
 	double buffer[2];
 	double c, c2, g, cg;
+#endif
 } rcFilter_t;
 #endif
 
 #ifdef LED_FILTER
-
-#define DENORMAL_OFFSET 1e-10
 typedef struct ledFilter_t {
+#ifdef USE_FIXEDPOINT
+	int64_t buffer[4]; // Q24
+	int64_t c, ci, bg, cg, c2; // Q30
+#else
 	double buffer[4];
 	double c, ci, feedback, bg, cg, c2;
+#endif
 } ledFilter_t;
 #endif
 
 static int8_t EmptySample[MAX_SAMPLE_LEN];
-static uint16_t bpmTab[256 - 32];
 
-static double dMixBufferL[MIX_BUF_SAMPLES];
-static double dMixBufferR[MIX_BUF_SAMPLES];
+// EmptySample is shared by all players, so it must never be written to
+static inline bool isEmptySample(const int8_t *smpPtr) {
+	return smpPtr >= EmptySample && smpPtr < &EmptySample[MAX_SAMPLE_LEN];
+}
+
+// sample header, decoded by moduleInit()
+typedef struct moduleSample_t {
+	const int8_t *start; // points into the module, or into SampleData for samples the replayer writes to
+	uint16_t length, repeat, replen; // in words
+	uint8_t finetune, volume;
+} moduleSample_t;
+
+// pattern data of one channel, decoded by moduleInit(). Indexed by (pattern * 64) + row
+typedef struct patternChannel_t {
+	uint16_t *period;
+	uint8_t *sample, *note, *effect, *param; // note is the PeriodTable index of period (finetune 0)
+} patternChannel_t;
+
+/* Voice deltas for all periods PT can produce (vibrato included), at the rate of the player. Every
+** player has its own, made by pt2play_PlaySong(), other periods calculate them.
+*/
+#define PERIOD_TAB_MIN 113
+#define PERIOD_TAB_MAX 1023
+
+typedef struct periodDelta_t {
+#ifdef USE_FIXEDPOINT
+	uint32_t delta;
+#ifdef USE_BLEP
+	uint32_t deltaMul;
+#endif
+#else
+	double dDelta;
+#ifdef USE_BLEP
+	double dDeltaMul;
+#endif
+#endif
+} periodDelta_t;
 
 struct pt_state {
-	int8_t *SampleStarts[31];
-	int8_t *SampleData;
-	uint8_t *SongDataPtr;
+	moduleSample_t Samples[31];
+	patternChannel_t Patterns[AMIGA_VOICES];
+	uint8_t *PatternData; // the arrays of Patterns[]
+	int8_t *SampleData; // private copies of the samples that the replayer writes to
+	const uint8_t *SongDataPtr;
+	uint8_t OrderList[128];
+	uint8_t SongLength;
 	ptChannel_t ChanTemp[AMIGA_VOICES];
 	paulaVoice_t paula[AMIGA_VOICES];
+	channelInfo_t channelInfo[AMIGA_VOICES];
 #ifdef USE_BLEP
 	blep_t blep[AMIGA_VOICES];
 	blep_t blepVol[AMIGA_VOICES];
-	double dOldVoiceDeltaMul;
 #endif
 #ifdef USE_HIGHPASS
 	rcFilter_t filterHi;
@@ -229,25 +366,35 @@ struct pt_state {
 	ledFilter_t filterLED;
 	bool LEDFilterOn;
 #endif
-	double dOldVoiceDelta;
+#ifdef USE_FIXEDPOINT
+	int32_t mixBuffer[MIX_BUF_SAMPLES * 2]; // interleaved L/R pairs (Q16)
+#else
+	double dMixBuffer[MIX_BUF_SAMPLES * 2]; // interleaved L/R pairs, so that one SSE2 register holds one stereo frame
+#endif
 	double dPeriodToDeltaDiv;
-	double dPrngStateL;
-	double dPrngStateR;
-	int32_t soundBufferSize;
 	int32_t audioRate;
 	int32_t samplesPerTickLeft;
 	int32_t samplesPerTick;
-	int32_t oldPeriod;
-	int32_t randSeed;
+	uint32_t ditherPos; // samples dithered since pt2play_PlaySong(), the dither of a sample is a hash of its position
 	int32_t masterVol;
-	uint32_t PattPosOff;
-	uint32_t sampleCounter;
+	uint32_t PattRow;
+	uint64_t samplePos; // stereo frames mixed since pt2play_PlaySong(), or the song time after pt2play_Seek()
+	uint64_t tickPos; // samplePos where the current tick started
+	uint8_t rowSongPos, rowPattPos; // the row being played, SongPosition and PatternPos already point to the next one
+	uint64_t tickTime, mixTime; // see PT2PLAY_TIMER()
+	struct pt2Checkpoint_t *checkpoints; // [128], one per order position, made by the first pt2play_Seek()
+	uint16_t bpmTab[256 - 32];
+	periodDelta_t periodDeltaTab[PERIOD_TAB_MAX - PERIOD_TAB_MIN + 1];
+	int32_t periodDeltaTabRate; // audioRate periodDeltaTab[] was made for, 0 before the first song
 	uint16_t PatternPos;
 	bool musicPaused;			// NOTE(peter): was volatile..
 	bool SongPlaying;			// NOTE(peter): was volatile..
 	bool PBreakFlag;
 	bool PosJumpAssert;
 	int8_t TempoMode;
+	int8_t interpolation;
+	bool interpolationSet; // by pt2play_SetInterpolation(), pt2play_PlaySong() only picks DEFAULT_INTERPOLATION until then
+	int8_t outputFormat;
 	int8_t SongPosition;
 	int8_t PBreakPosition;
 	int8_t PattDelTime;
@@ -339,6 +486,37 @@ static const int16_t PeriodTable[(37 * 16) + 15] = {
 	8739, 9253, 24625, 12851, 13365
 };
 
+/* Reverse map of PeriodTable, for each finetune: the first note whose period is <= the period,
+** which is what the replayer's period table scans look for. 37 means no note (negative periods).
+** Built by pt2play_initPlayer().
+*/
+#define PERIOD_NOTE_TAB_LEN 1024 // all periods from here and up map to note 0
+static uint8_t PeriodNoteTable[16][PERIOD_NOTE_TAB_LEN];
+
+static void initPeriodNoteTable(void) {
+	for(int32_t finetune = 0; finetune < 16; finetune++) {
+		const int16_t *periods = &PeriodTable[finetune * 37];
+
+		for(int32_t period = 0; period < PERIOD_NOTE_TAB_LEN; period++) {
+			int32_t note = 0;
+			while(note < 37 && period < periods[note])
+				note++;
+
+			PeriodNoteTable[finetune][period] = (uint8_t)note;
+		}
+	}
+}
+
+static inline int32_t periodToNote(uint8_t finetune, int32_t period) {
+	if(period < 0)
+		return 37;
+
+	if(period >= PERIOD_NOTE_TAB_LEN)
+		return 0;
+
+	return PeriodNoteTable[finetune][period];
+}
+
 #ifdef USE_BLEP
 /* Why this table is not represented as readable floating-point numbers:
 ** Accurate double representation in string format requires at least 14 digits and normalized
@@ -419,11 +597,45 @@ const double *get_minblep_table(void) {
 }
 #endif
 
-#define SWAP16(x) ((uint16_t)(((x) << 8) | ((x) >> 8)))
-#define PTR2WORD(x) ((uint16_t *)(x))
 #define CLAMP(x, low, high) (((x) > (high)) ? (high) : (((x) < (low)) ? (low) : (x)))
 #define CLAMP16(i) if ((int16_t)i != i) i = 0x7FFF ^ (i >> 31);
 
+static void calcPeriodDelta(double dPeriodToDeltaDiv, int32_t realPeriod, periodDelta_t *d) {
+#ifdef USE_FIXEDPOINT
+	d->delta = (uint32_t)(((dPeriodToDeltaDiv / realPeriod) * 4294967296.0) + 0.5);
+#ifdef USE_BLEP
+	d->deltaMul = (uint32_t)((UINT64_C(1) << 52) / d->delta);
+#endif
+#else
+	d->dDelta = dPeriodToDeltaDiv / realPeriod;
+#ifdef USE_BLEP
+	d->dDeltaMul = 1.0 / d->dDelta;
+#endif
+#endif
+}
+
+// only when the rate changed, songs at the same rate keep the table
+static void initPeriodDeltaTable(struct pt_state *state) {
+	if(state->periodDeltaTabRate == state->audioRate)
+		return;
+
+	for(int32_t i = PERIOD_TAB_MIN; i <= PERIOD_TAB_MAX; i++)
+		calcPeriodDelta(state->dPeriodToDeltaDiv, i, &state->periodDeltaTab[i - PERIOD_TAB_MIN]);
+
+	state->periodDeltaTabRate = state->audioRate;
+}
+
+#ifndef USE_FIXEDPOINT
+// called whenever Paula fetches a new sample, the linear and sinc tiers interpolate over these
+static inline void pushHistory(paulaVoice_t *v) {
+	const double dSmp = v->data[v->pos] * (1.0 / 128.0);
+
+	v->historyIndex = (v->historyIndex + 1) & (SINC_TAPS - 1);
+	v->dHistory[v->historyIndex] = dSmp;
+	v->dHistory[v->historyIndex + SINC_TAPS] = dSmp;
+}
+#endif
+
 static void paulaStartDMA(struct pt_state *state, int32_t ch) {
 	const int8_t *data;
 	int32_t length;
@@ -437,17 +649,27 @@ static void paulaStartDMA(struct pt_state *state, int32_t ch) {
 	if(length < 2)
 		length = 2; // for safety
 
-	v->dPhase = 0.0;
 	v->pos = 0;
 	v->data = data;
 	v->length = length;
 	v->active = true;
+
+#ifdef USE_FIXEDPOINT
+	v->phase = 0;
+#else
+	v->dPhase = 0.0;
+	pushHistory(v);
+#endif
 }
 
 static void paulaSetPeriod(struct pt_state *state, int32_t ch, uint16_t period) {
 	int32_t realPeriod;
+	periodDelta_t delta;
+	const periodDelta_t *d;
 	paulaVoice_t *v = &state->paula[ch];
 
+	state->channelInfo[ch].period = period;
+
 	if(period == 0)
 		realPeriod = 1 + 65535; // confirmed behavior on real Amiga
 	else if(period < 113)
@@ -455,24 +677,30 @@ static void paulaSetPeriod(struct pt_state *state, int32_t ch, uint16_t period)
 	else
 		realPeriod = period;
 
-	// if the new period was the same as the previous period, use cached deltas
-	if(realPeriod != state->oldPeriod) {
-		state->oldPeriod = realPeriod;
+	if(realPeriod <= PERIOD_TAB_MAX) {
+		d = &state->periodDeltaTab[realPeriod - PERIOD_TAB_MIN];
+	} else {
+		calcPeriodDelta(state->dPeriodToDeltaDiv, realPeriod, &delta);
+		d = &delta;
+	}
+
+#ifdef USE_FIXEDPOINT
+	v->delta = d->delta;
 
-		// cache these
-		state->dOldVoiceDelta = state->dPeriodToDeltaDiv / realPeriod;
 #ifdef USE_BLEP
-		state->dOldVoiceDeltaMul = 1.0 / state->dOldVoiceDelta;
+	v->deltaMul = d->deltaMul;
+	if(v->lastDelta == 0) v->lastDelta = v->delta;
+	if(v->lastDeltaMul == 0) v->lastDeltaMul = v->deltaMul;
 #endif
-	}
-
-	v->dDelta = state->dOldVoiceDelta;
+#else
+	v->dDelta = d->dDelta;
 
 #ifdef USE_BLEP
-	v->dDeltaMul = state->dOldVoiceDeltaMul;
+	v->dDeltaMul = d->dDeltaMul;
 	if(v->dLastDelta == 0.0) v->dLastDelta = v->dDelta;
 	if(v->dLastDeltaMul == 0.0) v->dLastDeltaMul = v->dDeltaMul;
 #endif
+#endif
 }
 
 static void paulaSetVolume(struct pt_state *state, int32_t ch, uint16_t vol) {
@@ -481,7 +709,13 @@ static void paulaSetVolume(struct pt_state *state, int32_t ch, uint16_t vol) {
 	if(vol > 64)
 		vol = 64; // confirmed behavior on real Amiga
 
+	state->channelInfo[ch].volume = (uint8_t)vol;
+
+#ifdef USE_FIXEDPOINT
+	state->paula[ch].volume = vol << 10; // 64 -> 1.0 in Q16
+#else
 	state->paula[ch].dVolume = vol * (1.0 / 64.0);
+#endif
 }
 
 static void paulaSetLength(struct pt_state *state, int32_t ch, uint16_t len) {
@@ -495,40 +729,59 @@ static void paulaSetData(struct pt_state *state, int32_t ch, const int8_t *src)
 	state->paula[ch].newData = src;
 }
 
+// called right after paulaStartDMA(), the note starts with the first sample mixed after this tick
+static void triggerChannel(struct pt_state *state, ptChannel_t *ch) {
+	channelInfo_t *info = &state->channelInfo[ch->n_chanindex];
+
+	info->triggerPos = state->samplePos;
+	info->triggerCount++;
+	info->sample = ch->n_samplenum;
+}
+
+#ifdef USE_FIXEDPOINT
+#define DOUBLE_TO_Q30(x) ((int64_t)(((x) * 1073741824.0) + 0.5))
+#define MUL_Q30(x, c) (((x) * (c)) >> 30)
+#endif
+
 #if defined(USE_HIGHPASS) || defined(USE_LOWPASS)
 static void calcRCFilterCoeffs(double dSr, double dHz, rcFilter_t *f) {
-	f->c = tan((M_PI * dHz) / dSr);
-	f->c2 = f->c * 2.0;
-	f->g = 1.0 / (1.0 + f->c);
-	f->cg = f->c * f->g;
-}
+	const double c = tan((M_PI * dHz) / dSr);
+	const double g = 1.0 / (1.0 + c);
 
-static void clearRCFilterState(rcFilter_t *f) {
-	f->buffer[0] = 0.0; // left channel
-	f->buffer[1] = 0.0; // right channel
+#ifdef USE_FIXEDPOINT
+	f->c2 = DOUBLE_TO_Q30(c * 2.0);
+	f->g = DOUBLE_TO_Q30(g);
+	f->cg = DOUBLE_TO_Q30(c * g);
+#else
+	f->c = c;
+	f->c2 = c * 2.0;
+	f->g = g;
+	f->cg = c * g;
+#endif
 }
 
-// aciddose: input 0 is resistor side of capacitor (low-pass), input 1 is reference side (high-pass)
-static inline double getLowpassOutput(rcFilter_t *f, const double input_0, const double input_1, const double buffer) {
-	return buffer * f->g + input_0 * f->cg + input_1 * (1.0 - f->cg);
+static void clearRCFilterState(rcFilter_t *f) {
+	f->buffer[0] = 0; // left channel
+	f->buffer[1] = 0; // right channel
 }
 
-static void inline RCLowPassFilter(rcFilter_t *f, const double *in, double *out) {
-	double output;
+#ifdef USE_FIXEDPOINT
+static inline void RCLowPassFilter(rcFilter_t *f, const int64_t *in, int64_t *out) {
+	int64_t output;
 
-	// left channel RC low-pass
-	output = getLowpassOutput(f, in[0], 0.0, f->buffer[0]);
-	f->buffer[0] += (in[0] - output) * f->c2;
+	// left channel RC low-pass (the high-pass input is always zero here)
+	output = MUL_Q30(f->buffer[0], f->g) + MUL_Q30(in[0], f->cg);
+	f->buffer[0] += MUL_Q30(in[0] - output, f->c2);
 	out[0] = output;
 
 	// right channel RC low-pass
-	output = getLowpassOutput(f, in[1], 0.0, f->buffer[1]);
-	f->buffer[1] += (in[1] - output) * f->c2;
+	output = MUL_Q30(f->buffer[1], f->g) + MUL_Q30(in[1], f->cg);
+	f->buffer[1] += MUL_Q30(in[1] - output, f->c2);
 	out[1] = output;
 }
 
-static void RCHighPassFilter(rcFilter_t *f, const double *in, double *out) {
-	double low[2];
+static void RCHighPassFilter(rcFilter_t *f, const int64_t *in, int64_t *out) {
+	int64_t low[2];
 
 	RCLowPassFilter(f, in, low);
 
@@ -536,13 +789,14 @@ static void RCHighPassFilter(rcFilter_t *f, const double *in, double *out) {
 	out[1] = in[1] - low[1]; // right channel high-pass
 }
 #endif
+#endif
 
 #ifdef LED_FILTER
 static void clearLEDFilterState(struct pt_state *state) {
-	state->filterLED.buffer[0] = 0.0; // left channel
-	state->filterLED.buffer[1] = 0.0;
-	state->filterLED.buffer[2] = 0.0; // right channel
-	state->filterLED.buffer[3] = 0.0;
+	state->filterLED.buffer[0] = 0; // left channel
+	state->filterLED.buffer[1] = 0;
+	state->filterLED.buffer[2] = 0; // right channel
+	state->filterLED.buffer[3] = 0;
 }
 
 /* Imperfect "LED" filter implementation. This may be further improved in the future.
@@ -572,99 +826,61 @@ static void calcLEDFilterCoeffs(const double sr, const double hz, const double f
 	const double ic = c > t ? 1.0 / ((1.0 - s * t) + s * c) : 1.0;
 	const double cg = c * g;
 	const double fbg = 1.0 / (1.0 + fb * cg * cg);
-
+	const double feedback = 2.0 * sigmoid(fb, 0.5);
+
+#ifdef USE_FIXEDPOINT
+	filter->c = DOUBLE_TO_Q30(c);
+	filter->ci = DOUBLE_TO_Q30(g);
+	filter->bg = DOUBLE_TO_Q30(fbg * feedback * ic);
+	filter->cg = DOUBLE_TO_Q30(cg);
+	filter->c2 = DOUBLE_TO_Q30(c * 2.0);
+#else
 	filter->c = c;
 	filter->ci = g;
-	filter->feedback = 2.0 * sigmoid(fb, 0.5);
+	filter->feedback = feedback;
 	filter->bg = fbg * filter->feedback * ic;
 	filter->cg = cg;
 	filter->c2 = c * 2.0;
+#endif
 }
 
-static inline void LEDFilter(ledFilter_t *f, const double *in, double *out) {
-	const double in_1 = DENORMAL_OFFSET;
-	const double in_2 = DENORMAL_OFFSET;
-
-	const double c = f->c;
-	const double g = f->ci;
-	const double cg = f->cg;
-	const double bg = f->bg;
-	const double c2 = f->c2;
+#ifdef USE_FIXEDPOINT
+// same as below, without the denormal offsets (not needed for integers)
+static inline void LEDFilter(ledFilter_t *f, const int64_t *in, int64_t *out) {
+	const int64_t c = f->c;
+	const int64_t g = f->ci;
+	const int64_t cg = f->cg;
+	const int64_t bg = f->bg;
+	const int64_t c2 = f->c2;
 
-	double *v = f->buffer;
+	int64_t *v = f->buffer;
 
 	// left channel
-	const double estimate_L = in_2 + g * (v[1] + c * (in_1 + g * (v[0] + c * in[0])));
-	const double y0_L = v[0] * g + in[0] * cg + in_1 + estimate_L * bg;
-	const double y1_L = v[1] * g + y0_L * cg + in_2;
+	const int64_t estimate_L = MUL_Q30(g, v[1] + MUL_Q30(c, MUL_Q30(g, v[0] + MUL_Q30(c, in[0]))));
+	const int64_t y0_L = MUL_Q30(v[0], g) + MUL_Q30(in[0], cg) + MUL_Q30(estimate_L, bg);
+	const int64_t y1_L = MUL_Q30(v[1], g) + MUL_Q30(y0_L, cg);
 
-	v[0] += c2 * (in[0] - y0_L);
-	v[1] += c2 * (y0_L - y1_L);
+	v[0] += MUL_Q30(c2, in[0] - y0_L);
+	v[1] += MUL_Q30(c2, y0_L - y1_L);
 	out[0] = y1_L;
 
 	// right channel
-	const double estimate_R = in_2 + g * (v[3] + c * (in_1 + g * (v[2] + c * in[1])));
-	const double y0_R = v[2] * g + in[1] * cg + in_1 + estimate_R * bg;
-	const double y1_R = v[3] * g + y0_R * cg + in_2;
+	const int64_t estimate_R = MUL_Q30(g, v[3] + MUL_Q30(c, MUL_Q30(g, v[2] + MUL_Q30(c, in[1]))));
+	const int64_t y0_R = MUL_Q30(v[2], g) + MUL_Q30(in[1], cg) + MUL_Q30(estimate_R, bg);
+	const int64_t y1_R = MUL_Q30(v[3], g) + MUL_Q30(y0_R, cg);
 
-	v[2] += c2 * (in[1] - y0_R);
-	v[3] += c2 * (y0_R - y1_R);
+	v[2] += MUL_Q30(c2, in[1] - y0_R);
+	v[3] += MUL_Q30(c2, y0_R - y1_R);
 	out[1] = y1_R;
 }
 #endif
-
-#ifdef USE_BLEP
-static inline void blepAdd(blep_t *b, double dOffset, double dAmplitude) {
-	double f = dOffset * BLEP_SP;
-
-	int32_t i = (int32_t)f; // get integer part of f
-	const double *dBlepSrc = get_minblep_table() + i;
-	f -= i; // remove integer part from f
-
-	i = b->index;
-	for(int32_t n = 0; n < BLEP_NS; n++) {
-		b->dBuffer[i] += dAmplitude * LERP(dBlepSrc[0], dBlepSrc[1], f);
-		dBlepSrc += BLEP_SP;
-
-		i = (i + 1) & BLEP_RNS;
-	}
-
-	b->samplesLeft = BLEP_NS;
-}
-
-/* 8bitbubsy: simplified, faster version of blepAdd for blep'ing voice volume.
-** Result is identical! (confirmed with binary comparison)
-*/
-static void blepVolAdd(blep_t *b, double dAmplitude) {
-	const double *dBlepSrc = get_minblep_table();
-
-	int32_t i = b->index;
-	for(int32_t n = 0; n < BLEP_NS; n++) {
-		b->dBuffer[i] += dAmplitude * (*dBlepSrc);
-		dBlepSrc += BLEP_SP;
-
-		i = (i + 1) & BLEP_RNS;
-	}
-
-	b->samplesLeft = BLEP_NS;
-}
-
-static inline double blepRun(blep_t *b, double dInput) {
-	double dBlepOutput = dInput + b->dBuffer[b->index];
-	b->dBuffer[b->index] = 0.0;
-
-	b->index = (b->index + 1) & BLEP_RNS;
-
-	b->samplesLeft--;
-	return dBlepOutput;
-}
 #endif
 
 static void SetReplayerBPM(struct pt_state *state, uint8_t bpm) {
 	if(bpm < 32)
 		return;
 
-	state->samplesPerTick = bpmTab[bpm - 32];
+	state->samplesPerTick = state->bpmTab[bpm - 32];
 }
 
 static void UpdateFunk(struct pt_state *state, ptChannel_t *ch) {
@@ -681,7 +897,9 @@ static void UpdateFunk(struct pt_state *state, ptChannel_t *ch) {
 			if(++ch->n_wavestart >= ch->n_loopstart + (ch->n_replen << 1))
 				ch->n_wavestart = ch->n_loopstart;
 
-			*ch->n_wavestart = -1 - *ch->n_wavestart;
+			// moduleInit() made a private copy of every sample that can be played on an EFx channel
+			if(!isEmptySample(ch->n_wavestart))
+				*(int8_t *)ch->n_wavestart = -1 - *ch->n_wavestart;
 		}
 	}
 }
@@ -724,8 +942,9 @@ static void KarplusStrong(struct pt_state *state, ptChannel_t *ch) {
 	int8_t *smpPtr;
 	uint16_t len;
 
-	smpPtr = ch->n_loopstart;
-	if(smpPtr != NULL) // SAFETY BUG FIX
+	// moduleInit() made a private copy of every sample that can be played on an E8x channel
+	smpPtr = (int8_t *)ch->n_loopstart;
+	if(smpPtr != NULL && !isEmptySample(smpPtr)) // SAFETY BUG FIX
 	{
 		len = ((ch->n_replen * 2) & 0xFFFF) - 1;
 		while(len--)
@@ -743,6 +962,7 @@ static void DoRetrg(struct pt_state *state, ptChannel_t *ch) {
 	paulaSetLength(state, ch->n_chanindex, ch->n_length);
 	paulaSetPeriod(state, ch->n_chanindex, ch->n_period);
 	paulaStartDMA(state, ch->n_chanindex);
+	triggerChannel(state, ch);
 
 	// these take effect after the current cycle is done
 	paulaSetData(state, ch->n_chanindex, ch->n_loopstart);
@@ -865,12 +1085,10 @@ static void Arpeggio(struct pt_state *state, ptChannel_t *ch) {
 	** and sound correct at the same time.
 	*/
 	periods = &PeriodTable[ch->n_finetune * 37];
-	for(int32_t baseNote = 0; baseNote < 37; baseNote++) {
-		if(ch->n_period >= periods[baseNote]) {
-			paulaSetPeriod(state, ch->n_chanindex, periods[baseNote + arpNote]);
-			break;
-		}
-	}
+
+	const int32_t baseNote = periodToNote(ch->n_finetune, ch->n_period);
+	if(baseNote < 37)
+		paulaSetPeriod(state, ch->n_chanindex, periods[baseNote + arpNote]);
 }
 
 static void PortaUp(struct pt_state *state, ptChannel_t *ch) {
@@ -923,17 +1141,7 @@ static void SetTonePorta(struct pt_state *state, ptChannel_t *ch) {
 	note = ch->n_note & 0xFFF;
 	portaPointer = &PeriodTable[ch->n_finetune * 37];
 
-	i = 0;
-	while(true) {
-		// portaPointer[36] = 0, so i=36 is safe
-		if(note >= portaPointer[i])
-			break;
-
-		if(++i >= 37) {
-			i = 35;
-			break;
-		}
-	}
+	i = (uint8_t)periodToNote(ch->n_finetune, note); // portaPointer[36] = 0, so this is never 37
 
 	if((ch->n_finetune & 8) && i > 0)
 		i--;
@@ -971,17 +1179,9 @@ static void TonePortNoChange(struct pt_state *state, ptChannel_t *ch) {
 	} else {
 		portaPointer = &PeriodTable[ch->n_finetune * 37];
 
-		i = 0;
-		while(true) {
-			// portaPointer[36] = 0, so i=36 is safe
-			if(ch->n_period >= portaPointer[i])
-				break;
-
-			if(++i >= 37) {
-				i = 35;
-				break;
-			}
-		}
+		i = (uint8_t)periodToNote(ch->n_finetune, ch->n_period);
+		if(i >= 37)
+			i = 35; // negative period
 
 		paulaSetPeriod(state, ch->n_chanindex, portaPointer[i]);
 	}
@@ -1180,14 +1380,7 @@ static void CheckEffects(struct pt_state *state, ptChannel_t *ch) {
 static void SetPeriod(struct pt_state *state, ptChannel_t *ch) {
 	int32_t i;
 
-	uint16_t note = ch->n_note & 0xFFF;
-	for(i = 0; i < 37; i++) {
-		// PeriodTable[36] = 0, so i=36 is safe
-		if(note >= PeriodTable[i])
-			break;
-	}
-
-	// aud_note_trigger[i] = 100;
+	i = ch->n_noteindex; // decoded from n_note by moduleInit()
 
 	// yes it's safe if i=37 because of zero-padding
 	ch->n_period = PeriodTable[(ch->n_finetune * 37) + i];
@@ -1208,42 +1401,41 @@ static void SetPeriod(struct pt_state *state, ptChannel_t *ch) {
 
 		paulaSetPeriod(state, ch->n_chanindex, ch->n_period);
 		paulaStartDMA(state, ch->n_chanindex);
+		triggerChannel(state, ch);
 	}
 
 	CheckMoreEffects(state, ch);
 }
 
 static void PlayVoice(struct pt_state *state, ptChannel_t *ch) {
-	uint8_t *dataPtr, sample, cmd;
-	uint16_t sampleOffset, repeat;
+	uint8_t sample, cmd;
+	uint16_t repeat;
+	const moduleSample_t *s;
+	const patternChannel_t *patt = &state->Patterns[ch->n_chanindex];
+	const uint32_t row = state->PattRow;
 
 	if(ch->n_note == 0 && ch->n_cmd == 0) {
 		paulaSetPeriod(state, ch->n_chanindex, ch->n_period);
 	}
 
-	dataPtr = &state->SongDataPtr[state->PattPosOff];
-
-	ch->n_note = (dataPtr[0] << 8) | dataPtr[1];
-	ch->n_cmd = (dataPtr[2] << 8) | dataPtr[3];
+	// the sample number is kept in the top nibbles, like in the MOD cell
+	sample = patt->sample[row];
+	ch->n_note = ((sample & 0xF0) << 8) | patt->period[row];
+	ch->n_cmd = ((sample & 0x0F) << 12) | (patt->effect[row] << 8) | patt->param[row];
+	ch->n_noteindex = patt->note[row];
 
-	sample = (dataPtr[0] & 0xF0) | (dataPtr[2] >> 4);
 	if(sample >= 1 && sample <= 31) // SAFETY BUG FIX: don't handle sample-numbers >31
 	{
+		s = &state->Samples[sample - 1];
 
-		// aud_channel_trigger[ch->n_chanindex & 0x3] = 100;
-		// aud_sample_trigger[sample - 1] = 100;
-
-
-		sample--;
-		sampleOffset = 42 + (30 * sample);
+		ch->n_samplenum = sample;
+		ch->n_start = s->start;
+		ch->n_finetune = s->finetune;
+		ch->n_volume = s->volume;
+		ch->n_length = s->length;
+		ch->n_replen = s->replen;
 
-		ch->n_start = state->SampleStarts[sample];
-		ch->n_finetune = state->SongDataPtr[sampleOffset + 2] & 0xF;
-		ch->n_volume = state->SongDataPtr[sampleOffset + 3];
-		ch->n_length = *PTR2WORD(&state->SongDataPtr[sampleOffset + 0]);
-		ch->n_replen = *PTR2WORD(&state->SongDataPtr[sampleOffset + 6]);
-
-		repeat = *PTR2WORD(&state->SongDataPtr[sampleOffset + 4]);
+		repeat = s->repeat;
 		if(repeat > 0) {
 			ch->n_loopstart = ch->n_start + (repeat << 1);
 			ch->n_wavestart = ch->n_loopstart;
@@ -1278,8 +1470,6 @@ static void PlayVoice(struct pt_state *state, ptChannel_t *ch) {
 	} else {
 		CheckMoreEffects(state, ch);
 	}
-
-	state->PattPosOff += 4;
 }
 
 static void NextPosition(struct pt_state *state) {
@@ -1288,7 +1478,7 @@ static void NextPosition(struct pt_state *state) {
 	state->PosJumpAssert = false;
 
 	state->SongPosition = (state->SongPosition + 1) & 0x7F;
-	if(state->SongPosition >= state->SongDataPtr[950])
+	if(state->SongPosition >= state->SongLength)
 		state->SongPosition = 0;
 }
 
@@ -1298,6 +1488,8 @@ static void tickReplayer(struct pt_state *state) {
 	if(!state->SongPlaying)
 		return;
 
+	state->tickPos = state->samplePos;
+
 	// PT quirk: CIA refreshes its timer values on the next interrupt, so do the real tempo change here
 	if(state->SetBPMFlag != 0) {
 		SetReplayerBPM(state, state->SetBPMFlag);
@@ -1307,9 +1499,11 @@ static void tickReplayer(struct pt_state *state) {
 	state->Counter++;
 	if(state->Counter >= state->CurrSpeed) {
 		state->Counter = 0;
+		state->rowSongPos = state->SongPosition;
+		state->rowPattPos = state->PatternPos >> 4;
 
 		if(state->PattDelTime2 == 0) {
-			state->PattPosOff = (1084 + (state->SongDataPtr[952 + state->SongPosition] * 1024)) + state->PatternPos;
+			state->PattRow = (state->OrderList[state->SongPosition] * 64) + (state->PatternPos >> 4);
 
 			for(i = 0; i < AMIGA_VOICES; i++) {
 				PlayVoice(state, &state->ChanTemp[i]);
@@ -1354,83 +1548,223 @@ static void tickReplayer(struct pt_state *state) {
 	}
 }
 
-static int8_t moduleInit(struct pt_state *state, uint8_t *moduleData) {
-	int8_t pattNum, *songSampleData;
+/* Checks that a module of dataLength bytes is a 31-sample 4-channel module that the replayer can
+** play without reading outside of it. moduleInit() trusts the module data, so use this first on
+** data from a file.
+*/
+static bool pt2play_CheckModule(const uint8_t *moduleData, uint32_t dataLength) {
+	uint32_t pattNum, offset;
+
+	if(moduleData == NULL || dataLength < 1084)
+		return false;
+
+	if(memcmp(&moduleData[1080], "M.K.", 4) != 0 && memcmp(&moduleData[1080], "M!K!", 4) != 0 &&
+		memcmp(&moduleData[1080], "FLT4", 4) != 0 && memcmp(&moduleData[1080], "4CHN", 4) != 0)
+		return false;
+
+	if(moduleData[950] == 0 || moduleData[950] > 128)
+		return false; // song length
+
+	pattNum = 0;
+	for(int32_t i = 0; i < 128; i++) {
+		if(moduleData[952 + i] > pattNum)
+			pattNum = moduleData[952 + i];
+	}
+
+	offset = 1084 + ((pattNum + 1) * 1024);
+	if(offset > dataLength)
+		return false;
+
+	// the samples, including what moduleInit() adds for overflowing loops
+	for(int32_t i = 0; i < 31; i++) {
+		const uint8_t *header = &moduleData[42 + (i * 30)];
+		const uint32_t length = (header[0] << 8) | header[1];
+		const uint32_t repeat = (header[4] << 8) | header[5];
+		const uint32_t replen = (header[6] << 8) | header[7];
+
+		if(length == 0)
+			continue;
+
+		uint32_t end = length;
+		if(replen > 1 && repeat + replen > length && repeat + replen <= MAX_SAMPLE_LEN / 2)
+			end = repeat + replen;
+
+		if(offset + (end * 2) > dataLength)
+			return false;
+
+		offset += length * 2;
+	}
+
+	return true;
+}
+
+// true if the effect makes the replayer write to the sample data of the channel
+static bool effectWritesSample(uint8_t effect, uint8_t param) {
+	if(effect != 0x0E)
+		return false;
+
+	if((param & 0xF0) == 0xF0 && (param & 0x0F) != 0)
+		return true; // EFx (funk repeat)
+
+#ifdef ENABLE_E8_EFFECT
+	if((param & 0xF0) == 0x80)
+		return true; // E8x (Karplus-Strong)
+#endif
+
+	return false;
+}
+
+/* The module data is never written to, so it can be in read-only memory and shared by several
+** players. The samples that the replayer does write to are copied to SampleData: samples that can
+** be played on a channel that has EFx (funk repeat) somewhere in the song, and non-looping samples
+** that need their first two bytes zeroed.
+*/
+static int8_t moduleInit(struct pt_state *state, const uint8_t *moduleData) {
 	uint8_t i;
-	uint16_t *p;
-	int32_t loopOverflowVal, totalSampleSize, sampleDataOffset;
-	ptChannel_t *ch;
+	const int8_t *songSampleData;
+	int32_t pattNum, loopOverflowVal, numRows, copySize;
+	bool chanWritesSample[AMIGA_VOICES], copySample[31];
+	moduleSample_t *s;
 
 	if(state->SampleData != NULL) {
 		free(state->SampleData);
 		state->SampleData = NULL;
 	}
 
-	for(i = 0; i < AMIGA_VOICES; i++) {
-		ch = &state->ChanTemp[i];
-
-		ch->n_chanindex = i;
-		ch->n_start = NULL;
-		ch->n_wavestart = NULL;
-		ch->n_loopstart = NULL;
+	if(state->PatternData != NULL) {
+		free(state->PatternData);
+		state->PatternData = NULL;
 	}
 
 	state->SongDataPtr = moduleData;
+	state->SongLength = moduleData[950];
+	memcpy(state->OrderList, &moduleData[952], sizeof(state->OrderList));
 
 	pattNum = 0;
 	for(i = 0; i < 128; i++) {
-		if(state->SongDataPtr[952 + i] > pattNum)
-			pattNum = state->SongDataPtr[952 + i];
+		if(state->OrderList[i] > pattNum)
+			pattNum = state->OrderList[i];
 	}
 	pattNum++;
 
-	// first count total sample size to allocate
-	totalSampleSize = 0;
-	for(i = 0; i < 31; i++) {
-		p = PTR2WORD(&state->SongDataPtr[42 + (i * 30)]);
-		totalSampleSize += (SWAP16(p[0]) * 2);
+	// decode the patterns, one array per field and channel
+	numRows = pattNum * 64;
+
+	state->PatternData = (uint8_t *)malloc(numRows * AMIGA_VOICES * (sizeof(uint16_t) + 4));
+	if(state->PatternData == NULL)
+		return false;
+
+	uint8_t *pattData = state->PatternData;
+	for(i = 0; i < AMIGA_VOICES; i++) {
+		patternChannel_t *patt = &state->Patterns[i];
+
+		patt->period = (uint16_t *)pattData; pattData += numRows * sizeof(uint16_t);
+		patt->sample = pattData; pattData += numRows;
+		patt->note = pattData; pattData += numRows;
+		patt->effect = pattData; pattData += numRows;
+		patt->param = pattData; pattData += numRows;
 	}
 
-	// setup and load samples
-	songSampleData = (int8_t *)&state->SongDataPtr[1084 + (pattNum * 1024)];
+	memset(chanWritesSample, 0, sizeof(chanWritesSample));
 
-	sampleDataOffset = 0;
-	for(i = 0; i < 31; i++) {
-		p = PTR2WORD(&state->SongDataPtr[42 + (i * 30)]);
+	for(int32_t row = 0; row < numRows; row++) {
+		const uint8_t *cell = &moduleData[1084 + (row * 16)];
 
-		// swap bytes in words (Amiga word -> Intel word)
-		p[0] = SWAP16(p[0]); // n_length
-		p[2] = SWAP16(p[2]); // n_repeat
-		p[3] = SWAP16(p[3]); // n_replen
+		for(i = 0; i < AMIGA_VOICES; i++, cell += 4) {
+			patternChannel_t *patt = &state->Patterns[i];
 
-		// set up sample pointer and load sample
-		if(p[0] == 0) {
-			state->SampleStarts[i] = EmptySample;
-		} else {
-			state->SampleStarts[i] = songSampleData;
+			patt->period[row] = ((cell[0] & 0x0F) << 8) | cell[1];
+			patt->sample[row] = (cell[0] & 0xF0) | (cell[2] >> 4);
+			patt->note[row] = (uint8_t)periodToNote(0, patt->period[row]);
+			patt->effect[row] = cell[2] & 0x0F;
+			patt->param[row] = cell[3];
+
+			if(effectWritesSample(patt->effect[row], patt->param[row]))
+				chanWritesSample[i] = true;
+		}
+	}
+
+	// every sample that is played on such a channel needs a private copy
+	memset(copySample, 0, sizeof(copySample));
 
-			sampleDataOffset += p[0] * 2;
-			songSampleData += p[0] * 2;
+	for(i = 0; i < AMIGA_VOICES; i++) {
+		if(!chanWritesSample[i])
+			continue;
+
+		for(int32_t row = 0; row < numRows; row++) {
+			const uint8_t sample = state->Patterns[i].sample[row];
+			if(sample >= 1 && sample <= 31)
+				copySample[sample - 1] = true;
+		}
+	}
+
+	// decode the sample headers and set up the sample pointers
+	songSampleData = (const int8_t *)&moduleData[1084 + (pattNum * 1024)];
+
+	for(i = 0; i < 31; i++) {
+		const uint8_t *header = &moduleData[42 + (i * 30)];
+		s = &state->Samples[i];
+
+		// Amiga words are big endian
+		s->length = (header[0] << 8) | header[1];
+		s->finetune = header[2] & 0xF;
+		s->volume = header[3];
+		s->repeat = (header[4] << 8) | header[5];
+		s->replen = (header[6] << 8) | header[7];
+
+		if(s->length == 0) {
+			s->start = EmptySample;
+		} else {
+			s->start = songSampleData;
+			songSampleData += s->length * 2;
 		}
 
-		if(p[3] == 0)
-			p[3] = 1; // fix illegal loop length (f.ex. from "Fasttracker II" .MODs)
+		if(s->replen == 0)
+			s->replen = 1; // fix illegal loop length (f.ex. from "Fasttracker II" .MODs)
 
 		// adjust sample length if loop was overflowing
-		if(p[3] > 1 && p[2] + p[3] > p[0]) {
-			loopOverflowVal = (p[2] + p[3]) - p[0];
-			if((p[0] + loopOverflowVal) <= MAX_SAMPLE_LEN / 2) {
-				p[0] += (uint16_t)loopOverflowVal;
+		if(s->replen > 1 && s->repeat + s->replen > s->length) {
+			loopOverflowVal = (s->repeat + s->replen) - s->length;
+			if((s->length + loopOverflowVal) <= MAX_SAMPLE_LEN / 2) {
+				s->length += (uint16_t)loopOverflowVal;
 			} else {
-				p[2] = 0;
-				p[3] = 2;
+				s->repeat = 0;
+				s->replen = 2;
 			}
 		}
 
-		if(p[0] >= 1 && p[2] + p[3] <= 1) {
-			// if no loop, zero first two samples of data to prevent "beep"
-			state->SampleStarts[i][0] = 0;
-			state->SampleStarts[i][1] = 0;
+		if(s->length >= 1 && s->repeat + s->replen <= 1 && (s->start[0] != 0 || s->start[1] != 0))
+			copySample[i] = true; // no loop, the first two samples of data will be zeroed
+	}
+
+	// copy the samples that are written to
+	copySize = 0;
+	for(i = 0; i < 31; i++) {
+		if(copySample[i] && !isEmptySample(state->Samples[i].start))
+			copySize += state->Samples[i].length * 2;
+	}
+
+	if(copySize > 0) {
+		state->SampleData = (int8_t *)malloc(copySize);
+		if(state->SampleData == NULL)
+			return false;
+
+		int8_t *copy = state->SampleData;
+		for(i = 0; i < 31; i++) {
+			s = &state->Samples[i];
+			if(!copySample[i] || isEmptySample(s->start))
+				continue;
+
+			memcpy(copy, s->start, s->length * 2);
+
+			if(s->repeat + s->replen <= 1) {
+				// if no loop, zero first two samples of data to prevent "beep"
+				copy[0] = 0;
+				copy[1] = 0;
+			}
+
+			s->start = copy;
+			copy += s->length * 2;
 		}
 	}
 
@@ -1460,6 +1794,19 @@ static void calculatePans(struct pt_state *state, int8_t stereoSeparation) {
 
 	scaledPanPos = (stereoSeparation * 128) / 100;
 
+#ifdef USE_FIXEDPOINT
+	p = (128 - scaledPanPos) * (1.0 / 256.0);
+	state->paula[0].panL = (int32_t)((cosApx(p) * 65536.0) + 0.5);
+	state->paula[0].panR = (int32_t)((sinApx(p) * 65536.0) + 0.5);
+	state->paula[3].panL = state->paula[0].panL;
+	state->paula[3].panR = state->paula[0].panR;
+
+	p = (128 + scaledPanPos) * (1.0 / 256.0);
+	state->paula[1].panL = (int32_t)((cosApx(p) * 65536.0) + 0.5);
+	state->paula[1].panR = (int32_t)((sinApx(p) * 65536.0) + 0.5);
+	state->paula[2].panL = state->paula[1].panL;
+	state->paula[2].panR = state->paula[1].panR;
+#else
 	p = (128 - scaledPanPos) * (1.0 / 256.0);
 	state->paula[0].dPanL = cosApx(p);
 	state->paula[0].dPanR = sinApx(p);
@@ -1471,153 +1818,1213 @@ static void calculatePans(struct pt_state *state, int8_t stereoSeparation) {
 	state->paula[1].dPanR = sinApx(p);
 	state->paula[2].dPanL = cosApx(p);
 	state->paula[2].dPanR = sinApx(p);
+#endif
 }
 
 static void resetAudioDithering(struct pt_state *state) {
-	state->randSeed = INITIAL_DITHER_SEED;
-	state->dPrngStateL = 0.0;
-	state->dPrngStateR = 0.0;
+	state->ditherPos = 0;
 }
 
-static inline int32_t random32(struct pt_state *state) {
-	// LCG random 32-bit generator (quite good and fast)
-	state->randSeed = state->randSeed * 134775813 + 1;
-	return state->randSeed;
+/* Counter-based random numbers for the dither: the value for sample n (L and R counted apart) is a
+** hash of n, so any number of them can be made at once, and the previous one that the triangular
+** dither subtracts is just the hash of n - 2. The hash is "lowbias32" by Chris Wellons.
+*/
+static inline int32_t ditherHash(uint32_t n) {
+	uint32_t x = n + DITHER_SEED;
+
+	x ^= x >> 16;
+	x *= 0x7FEB352D;
+	x ^= x >> 15;
+	x *= 0x846CA68B;
+	x ^= x >> 16;
+	return (int32_t)x;
 }
 
-#define POST_MIX_STAGE_1 \
-	dOut[0] = dMixBufferL[i]; \
-	dOut[1] = dMixBufferR[i]; \
+#ifdef MIX_SIMD_X86
+__attribute__((target("avx2")))
+static inline __m256i ditherHashAVX2(__m256i n) {
+	__m256i x = _mm256_add_epi32(n, _mm256_set1_epi32(DITHER_SEED));
 
-#define POST_MIX_STAGE_2 \
-	/* normalize and flip phase (A500/A1200 has an inverted audio signal) */ \
-	dOut[0] *= (-INT16_MAX / (double)AMIGA_VOICES); \
-	dOut[1] *= (-INT16_MAX / (double)AMIGA_VOICES); \
-	\
-	/* left channel - 1-bit triangular dithering (high-pass filtered) */ \
-	dPrng = random32(state) * (0.5 / INT32_MAX); /* -0.5..0.5 */ \
-	dOut[0] = (dOut[0] + dPrng) - state->dPrngStateL; \
-	state->dPrngStateL = dPrng; \
-	smp32 = (int32_t)dOut[0]; \
-	smp32 = (smp32 * state->masterVol) >> 8; \
-	CLAMP16(smp32); \
-	*stream++ = (int16_t)smp32; \
-	\
-	/* right channel */ \
-	dPrng = random32(state) * (0.5 / INT32_MAX); \
-	dOut[1] = (dOut[1] + dPrng) - state->dPrngStateR; \
-	state->dPrngStateR = dPrng; \
-	smp32 = (int32_t)dOut[1]; \
-	smp32 = (smp32 * state->masterVol) >> 8; \
-	CLAMP16(smp32); \
-	*stream++ = (int16_t)smp32; \
-
-static void mixAudio(struct pt_state *state, int16_t *stream, int32_t sampleBlockLength) {
-	int32_t i, j, smp32;
-	double dPrng, dSmp, dVol, dOut[2];
-	paulaVoice_t *v;
-#ifdef USE_BLEP
-	blep_t *bSmp, *bVol;
+	x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+	x = _mm256_mullo_epi32(x, _mm256_set1_epi32(0x7FEB352D));
+	x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 15));
+	x = _mm256_mullo_epi32(x, _mm256_set1_epi32((int32_t)0x846CA68B));
+	x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+	return x;
+}
 #endif
 
-	memset(dMixBufferL, 0, sampleBlockLength * sizeof(double));
-	memset(dMixBufferR, 0, sampleBlockLength * sizeof(double));
-
-	if(state->musicPaused) {
-		memset(stream, 0, sampleBlockLength * (sizeof(int16_t) * 2));
-		return;
-	}
+static inline int32_t outputFrameSize(int8_t format) {
+	return (format == OUTPUT_INT16) ? (int32_t)(sizeof(int16_t) * 2) : 8; // int32 and float32
+}
 
-	v = state->paula;
-	for(i = 0; i < AMIGA_VOICES; i++, v++) {
-		if(!v->active)
-			continue;
+/* Mixer kernels.
+** Between two phase wraps a Paula voice outputs the same sample at the same volume, so the
+** voice loop works on runs instead of single samples. A run is either mixed as a constant
+** (no BLEP pending), or through the BLEP ring buffers for as long as any of them is pending.
+** mixVoice() is compiled once per instruction set and picked at runtime in pt2play_initPlayer(),
+** the scalar version is the fallback. The double mixer also has the linear and sinc tiers, which
+** mix sample by sample, and leaves the BLEP out for the nearest tier.
+*/
+enum {
+	MIX_KERNEL_SCALAR = 0,
+	MIX_KERNEL_SSE2 = 1,
+	MIX_KERNEL_AVX2 = 2
+};
 
-#ifdef USE_BLEP
-		bSmp = &state->blep[i];
-		bVol = &state->blepVol[i];
-#endif
-		for(j = 0; j < sampleBlockLength; j++) {
-			dSmp = v->data[v->pos] * (1.0 / 128.0);
-			dVol = v->dVolume;
+#ifdef USE_FIXEDPOINT
+/* FIXED-POINT MIXER
+** Same mixer as below, with integers only:
+** - phase is a 32.32 accumulator (pos is the integer part, phase the fraction)
+** - samples, volume, pans and the mixbuffer are Q16 (1.0 = 65536), products go through int64_t
+** - the BLEP table and the filter coefficients are Q30, the filter state has 24 fractional bits
+**
+** Error bound against the double mixer, measured on a three minute 4-channel module at 44.1 and
+** 48kHz: the output stays within +/-2 LSB of it (+/-1 LSB without BLEP), with an RMS error of
+** about 0.6 LSB, mostly the dither landing on the other side of a rounding step.
+**
+** This is meant for CPUs without a fast FPU, on x86-64 the double mixer is faster.
+*/
 
 #ifdef USE_BLEP
-			if(dSmp != bSmp->dLastValue) {
-				if(v->dLastDelta > v->dLastPhase) {
-					// div->mul trick: v->dLastDeltaMul is 1.0 / v->dLastDelta
-					blepAdd(bSmp, v->dLastPhase * v->dLastDeltaMul, bSmp->dLastValue - dSmp);
-				}
+// minblep table (Q30) transposed to [phase][tap], so that the taps of one BLEP are contiguous
+static int32_t blepTable[BLEP_SP + 1][BLEP_NS];
 
-				bSmp->dLastValue = dSmp;
-			}
-
-			if(dVol != bVol->dLastValue) {
-				blepVolAdd(bVol, bVol->dLastValue - dVol);
-				bVol->dLastValue = dVol;
-			}
+static void initBlepTable(void) {
+	const double *dBlepSrc = get_minblep_table();
 
-			if(bSmp->samplesLeft > 0) dSmp = blepRun(bSmp, dSmp);
-			if(bVol->samplesLeft > 0) dVol = blepRun(bVol, dVol);
+	for(int32_t i = 0; i <= BLEP_SP; i++) {
+		for(int32_t n = 0; n < BLEP_NS; n++)
+			blepTable[i][n] = (int32_t)DOUBLE_TO_Q30(dBlepSrc[i + (n * BLEP_SP)]);
+	}
+}
 #endif
-			dSmp *= dVol;
 
-			dMixBufferL[j] += dSmp * v->dPanL;
-			dMixBufferR[j] += dSmp * v->dPanR;
+static inline void constRunScalar(int32_t *mix, int32_t numSamples, int32_t outL, int32_t outR) {
+	for(int32_t i = 0; i < numSamples; i++) {
+		mix[0] += outL;
+		mix[1] += outR;
+		mix += 2;
+	}
+}
 
-			v->dPhase += v->dDelta;
-			if(v->dPhase >= 1.0) {
-				v->dPhase -= 1.0;
 #ifdef USE_BLEP
-				v->dLastPhase = v->dPhase;
-				v->dLastDelta = v->dDelta;
-				v->dLastDeltaMul = v->dDeltaMul;
-#endif
-				if(++v->pos >= v->length) {
-					v->pos = 0;
-
-					// re-fetch Paula register values now
-					v->length = v->newLength;
-					v->data = v->newData;
-				}
-			}
-		}
+// runs the sample and the volume BLEP over a contiguous part of their buffers
+static inline void blepRunScalar(int32_t *mix, int32_t numSamples, int32_t smp, int32_t vol, int32_t *blepSmp, int32_t *blepVol, int32_t panL, int32_t panR) {
+	for(int32_t i = 0; i < numSamples; i++) {
+		const int64_t out = ((int64_t)(smp + blepSmp[i]) * (vol + blepVol[i])) >> 16;
+		blepSmp[i] = 0;
+		blepVol[i] = 0;
+
+		mix[0] += (int32_t)((out * panL) >> 16);
+		mix[1] += (int32_t)((out * panR) >> 16);
+		mix += 2;
 	}
+}
 
-#ifdef LED_FILTER
-	if(state->LEDFilterOn) {
-		for(i = 0; i < sampleBlockLength; i++) {
-			POST_MIX_STAGE_1
+// adds a contiguous part of the taps of a BLEP, frac is Q16
+static inline void blepAddTaps(int32_t *buffer, int32_t numTaps, const int32_t *tab, const int32_t *tabNext, int32_t frac, int32_t amplitude) {
+	for(int32_t n = 0; n < numTaps; n++) {
+		const int64_t lerp = tab[n] + (((int64_t)(tabNext[n] - tab[n]) * frac) >> 16);
+		buffer[n] += (int32_t)((amplitude * lerp) >> 30);
+	}
+}
+#endif
+
+#ifdef MIX_SIMD_X86
+__attribute__((target("sse2")))
+static inline void constRunSSE2(int32_t *mix, int32_t numSamples, int32_t outL, int32_t outR) {
+	const __m128i vOut = _mm_set_epi32(outR, outL, outR, outL);
+
+	int32_t i = 0;
+	for(; i + 2 <= numSamples; i += 2) {
+		_mm_storeu_si128((__m128i *)mix, _mm_add_epi32(_mm_loadu_si128((const __m128i *)mix), vOut));
+		mix += 4;
+	}
+
+	if(i < numSamples)
+		constRunScalar(mix, numSamples - i, outL, outR);
+}
+
+__attribute__((target("avx2")))
+static inline void constRunAVX2(int32_t *mix, int32_t numSamples, int32_t outL, int32_t outR) {
+	const __m256i vOut = _mm256_set_epi32(outR, outL, outR, outL, outR, outL, outR, outL);
+
+	int32_t i = 0;
+	for(; i + 4 <= numSamples; i += 4) {
+		_mm256_storeu_si256((__m256i *)mix, _mm256_add_epi32(_mm256_loadu_si256((const __m256i *)mix), vOut));
+		mix += 8;
+	}
+
+	if(i < numSamples)
+		constRunSSE2(mix, numSamples - i, outL, outR);
+}
+#endif
+
+// kernel is a constant in each mixVoice*() below, so the unused paths are compiled out
+static inline __attribute__((always_inline)) void constRun(const int32_t kernel, int32_t *mix, int32_t numSamples, int32_t outL, int32_t outR) {
+#ifdef MIX_SIMD_X86
+	if(kernel == MIX_KERNEL_AVX2) {
+		constRunAVX2(mix, numSamples, outL, outR);
+		return;
+	}
+
+	if(kernel == MIX_KERNEL_SSE2) {
+		constRunSSE2(mix, numSamples, outL, outR);
+		return;
+	}
+#endif
+	constRunScalar(mix, numSamples, outL, outR);
+}
+
+#ifdef USE_BLEP
+// offset is the BLEP position in Q20 (0..1), an offset of 0 is the old blepVolAdd()
+static inline void blepAddBlock(blep_t *b, uint32_t offset, int32_t amplitude) {
+	const int32_t i = offset >> 16;
+	const int32_t frac = offset & 0xFFFF;
+
+	// the ring buffer is split in at most two contiguous parts
+	int32_t numTaps = (BLEP_RNS + 1) - b->index;
+	if(numTaps > BLEP_NS)
+		numTaps = BLEP_NS;
+
+	blepAddTaps(&b->buffer[b->index], numTaps, blepTable[i], blepTable[i + 1], frac, amplitude);
+	if(numTaps < BLEP_NS)
+		blepAddTaps(b->buffer, BLEP_NS - numTaps, &blepTable[i][numTaps], &blepTable[i + 1][numTaps], frac, amplitude);
+
+	b->samplesLeft = BLEP_NS;
+}
+
+// see the double version below
+static inline void mixBlepRun(paulaVoice_t *v, blep_t *bSmp, blep_t *bVol, int32_t *mix, int32_t numSamples, int32_t smp, int32_t vol) {
+	while(numSamples > 0) {
+		int32_t n = (BLEP_RNS + 1) - bSmp->index; // don't cross the ring buffer end
+		if(n > numSamples)
+			n = numSamples;
+
+		blepRunScalar(mix, n, smp, vol, &bSmp->buffer[bSmp->index], &bVol->buffer[bSmp->index], v->panL, v->panR);
+
+		bSmp->index = (bSmp->index + n) & BLEP_RNS;
+		bVol->index = bSmp->index;
+		bSmp->samplesLeft = (bSmp->samplesLeft > n) ? bSmp->samplesLeft - n : 0;
+		bVol->samplesLeft = (bVol->samplesLeft > n) ? bVol->samplesLeft - n : 0;
+
+		mix += n * 2;
+		numSamples -= n;
+	}
+}
+#endif
+
+static inline __attribute__((always_inline)) void mixVoiceKernel(const int32_t kernel, struct pt_state *state, int32_t ch, int32_t *mix, int32_t numSamples) {
+	paulaVoice_t *v = &state->paula[ch];
+#ifdef USE_BLEP
+	blep_t *bSmp = &state->blep[ch];
+	blep_t *bVol = &state->blepVol[ch];
+#endif
+
+	while(numSamples > 0) {
+		// sample and volume can only change on a phase wrap (or between two mixAudio() calls)
+		const int32_t smp = v->data[v->pos] << 9; // -128..127 -> Q16
+		const int32_t vol = v->volume;
+
+#ifdef USE_BLEP
+		if(smp != bSmp->lastValue) {
+			if(v->lastDelta > v->lastPhase) {
+				// lastDeltaMul is 2^52 / lastDelta, so this is lastPhase / lastDelta in Q20
+				blepAddBlock(bSmp, (uint32_t)(((uint64_t)v->lastPhase * v->lastDeltaMul) >> 32), bSmp->lastValue - smp);
+			}
+
+			bSmp->lastValue = smp;
+		}
+
+		if(vol != bVol->lastValue) {
+			blepAddBlock(bVol, 0, bVol->lastValue - vol);
+			bVol->lastValue = vol;
+		}
+#endif
+
+		// find the length of this run, a wrap is the carry out of the 32-bit fraction
+		uint32_t phase = v->phase;
+		bool wrapped = false;
+		int32_t runLength = 0;
+		while(runLength < numSamples) {
+			runLength++;
+
+			phase += v->delta;
+			if(phase < v->delta) {
+				wrapped = true;
+				break;
+			}
+		}
+
+		// the level is the same for the whole run (the BLEP ramps are left out), so the meter costs nothing per sample
+		const int32_t level = (int32_t)(((int64_t)(smp < 0 ? -smp : smp) * vol) >> 16);
+		if(level > v->meterPeak)
+			v->meterPeak = level;
+		v->meterSumSq += (uint64_t)((int64_t)level * level) * runLength;
+
+		int32_t constLength = runLength;
+#ifdef USE_BLEP
+		int32_t blepLength = (bSmp->samplesLeft > bVol->samplesLeft) ? bSmp->samplesLeft : bVol->samplesLeft;
+		if(blepLength > runLength)
+			blepLength = runLength;
+
+		if(blepLength > 0) {
+			mixBlepRun(v, bSmp, bVol, mix, blepLength, smp, vol);
+			constLength -= blepLength;
+		}
+#endif
+		if(constLength > 0) {
+			const int64_t out = ((int64_t)smp * vol) >> 16;
+			constRun(kernel, mix + ((runLength - constLength) * 2), constLength, (int32_t)((out * v->panL) >> 16), (int32_t)((out * v->panR) >> 16));
+		}
+
+		mix += runLength * 2;
+		numSamples -= runLength;
+
+		if(wrapped) {
+#ifdef USE_BLEP
+			v->lastPhase = phase;
+			v->lastDelta = v->delta;
+			v->lastDeltaMul = v->deltaMul;
+#endif
+			if(++v->pos >= v->length) {
+				v->pos = 0;
+
+				// re-fetch Paula register values now
+				v->length = v->newLength;
+				v->data = v->newData;
+			}
+		}
+
+		v->phase = phase;
+	}
+}
+
+static void mixVoiceScalar(struct pt_state *state, int32_t ch, int32_t *mix, int32_t numSamples) {
+	mixVoiceKernel(MIX_KERNEL_SCALAR, state, ch, mix, numSamples);
+}
+
+#ifdef MIX_SIMD_X86
+__attribute__((target("sse2")))
+static void mixVoiceSSE2(struct pt_state *state, int32_t ch, int32_t *mix, int32_t numSamples) {
+	mixVoiceKernel(MIX_KERNEL_SSE2, state, ch, mix, numSamples);
+}
+
+__attribute__((target("avx2")))
+static void mixVoiceAVX2(struct pt_state *state, int32_t ch, int32_t *mix, int32_t numSamples) {
+	mixVoiceKernel(MIX_KERNEL_AVX2, state, ch, mix, numSamples);
+}
+#endif
+
+static void (*mixVoice)(struct pt_state *state, int32_t ch, int32_t *mix, int32_t numSamples) = mixVoiceScalar;
+
+#define POST_MIX_STAGE_1 \
+	out[0] = (int64_t)state->mixBuffer[(i * 2) + 0] << 8; /* Q16 -> Q24 */ \
+	out[1] = (int64_t)state->mixBuffer[(i * 2) + 1] << 8; \
+
+#define POST_MIX_STAGE_2 \
+	/* normalize to 1/256th of a sample (Q24 * -INT16_MAX / AMIGA_VOICES -> Q8) and flip phase */ \
+	state->mixBuffer[(i * 2) + 0] = (int32_t)((out[0] * -INT16_MAX) >> 18); \
+	state->mixBuffer[(i * 2) + 1] = (int32_t)((out[1] * -INT16_MAX) >> 18); \
+
+// the mixbuffer holds Q8 samples after the filters, these write them out in the output format
+static void outputInt16(struct pt_state *state, void *stream, int32_t numSamples) {
+	const int32_t *mix = state->mixBuffer;
+	int16_t *out = (int16_t *)stream;
+	uint32_t n = state->ditherPos;
+
+	// 1-bit triangular dithering (high-pass filtered)
+	for(int32_t i = 0; i < numSamples * 2; i++, n++) {
+		int32_t smp32 = (mix[i] + (ditherHash(n) >> 24)) - (ditherHash(n - 2) >> 24); // -0.5..0.5 (Q8)
+		smp32 /= 256; // truncates towards zero, like a double -> int cast
+		smp32 = (smp32 * state->masterVol) >> 8;
+		CLAMP16(smp32);
+		out[i] = (int16_t)smp32;
+	}
+
+	state->ditherPos = n;
+}
+
+static void outputInt32(struct pt_state *state, void *stream, int32_t numSamples) {
+	int32_t *out = (int32_t *)stream;
+
+	for(int32_t i = 0; i < numSamples * 2; i++) {
+		const int64_t smp = (int64_t)state->mixBuffer[i] * state->masterVol; // Q8 * (256 = 1.0) -> 16.16
+		out[i] = (int32_t)CLAMP(smp, INT32_MIN, INT32_MAX);
+	}
+}
+
+static void outputFloat32(struct pt_state *state, void *stream, int32_t numSamples) {
+	const float fScale = state->masterVol * (1.0f / (256.0f * 256.0f * 32768.0f));
+	float *out = (float *)stream;
+
+	for(int32_t i = 0; i < numSamples * 2; i++)
+		out[i] = state->mixBuffer[i] * fScale;
+}
+
+static void (*outputBlock[OUTPUT_FORMAT_COUNT])(struct pt_state *state, void *stream, int32_t numSamples) = { outputInt16, outputInt32, outputFloat32 };
+
+static void mixAudio(struct pt_state *state, void *stream, int32_t sampleBlockLength) {
+	int32_t i;
+	int64_t out[2];
+
+	state->samplePos += sampleBlockLength;
+	memset(state->mixBuffer, 0, sampleBlockLength * (sizeof(int32_t) * 2));
+
+	if(state->musicPaused) {
+		memset(stream, 0, sampleBlockLength * outputFrameSize(state->outputFormat));
+		return;
+	}
+
+	for(i = 0; i < AMIGA_VOICES; i++) {
+		if(state->paula[i].active)
+			mixVoice(state, i, state->mixBuffer, sampleBlockLength);
+	}
+
+	for(i = 0; i < sampleBlockLength; i++) {
+		POST_MIX_STAGE_1
 
 #ifdef USE_LOWPASS
-			RCLowPassFilter(&state->filterLo, dOut, dOut);
+		RCLowPassFilter(&state->filterLo, out, out);
 #endif
 
 #ifdef LED_FILTER
-			LEDFilter(&state->filterLED, dOut, dOut);
+		if(state->LEDFilterOn)
+			LEDFilter(&state->filterLED, out, out);
 #endif
 
 #ifdef USE_HIGHPASS
-			RCHighPassFilter(&state->filterHi, dOut, dOut);
+		RCHighPassFilter(&state->filterHi, out, out);
 #endif
-			POST_MIX_STAGE_2
+
+		POST_MIX_STAGE_2
+	}
+
+	outputBlock[state->outputFormat](state, stream, sampleBlockLength);
+}
+#else
+#ifdef USE_BLEP
+// minblep table transposed to [phase][tap], so that the taps of one BLEP are contiguous
+static double dBlepTable[BLEP_SP + 1][BLEP_NS];
+
+static void initBlepTable(void) {
+	const double *dBlepSrc = get_minblep_table();
+
+	for(int32_t i = 0; i <= BLEP_SP; i++) {
+		for(int32_t n = 0; n < BLEP_NS; n++)
+			dBlepTable[i][n] = dBlepSrc[i + (n * BLEP_SP)];
+	}
+}
+#endif
+
+/* Blackman-windowed sinc, [phase][tap] like dBlepTable. The cutoff is at the Nyquist frequency of
+** the voice, which is always below the one of the output as the rate is at least 32kHz. Each phase
+** is normalized to a gain of 1.0.
+*/
+static double dSincTable[SINC_PHASES + 1][SINC_TAPS];
+
+static void initSincTable(void) {
+	for(int32_t i = 0; i <= SINC_PHASES; i++) {
+		double dSum = 0.0;
+
+		for(int32_t n = 0; n < SINC_TAPS; n++) {
+			// distance from the tap to the interpolated point, which is between the middle two taps
+			const double x = n - ((SINC_TAPS / 2) - 1) - ((double)i / SINC_PHASES);
+			const double w = (x == 0.0) ? 1.0 : sin(M_PI * x) / (M_PI * x);
+			const double dWindow = 0.42 + (0.5 * cos(M_PI * x / (SINC_TAPS / 2))) + (0.08 * cos(2.0 * M_PI * x / (SINC_TAPS / 2)));
+
+			dSincTable[i][n] = w * ((fabs(x) < (SINC_TAPS / 2)) ? dWindow : 0.0);
+			dSum += dSincTable[i][n];
 		}
-	} else
+
+		for(int32_t n = 0; n < SINC_TAPS; n++)
+			dSincTable[i][n] /= dSum;
+	}
+}
+
+static inline void constRunScalar(double *dMix, int32_t numSamples, double dOutL, double dOutR) {
+	for(int32_t i = 0; i < numSamples; i++) {
+		dMix[0] += dOutL;
+		dMix[1] += dOutR;
+		dMix += 2;
+	}
+}
+
+#ifdef USE_BLEP
+// runs the sample and the volume BLEP over a contiguous part of their buffers
+static inline void blepRunScalar(double *dMix, int32_t numSamples, double dSmp, double dVol, double *dBlepSmp, double *dBlepVol, double dPanL, double dPanR) {
+	for(int32_t i = 0; i < numSamples; i++) {
+		const double dOut = (dSmp + dBlepSmp[i]) * (dVol + dBlepVol[i]);
+		dBlepSmp[i] = 0.0;
+		dBlepVol[i] = 0.0;
+
+		dMix[0] += dOut * dPanL;
+		dMix[1] += dOut * dPanR;
+		dMix += 2;
+	}
+}
+
+// adds a contiguous part of the taps of a BLEP
+static inline void blepAddScalar(double *dBuffer, int32_t numTaps, const double *dTab, const double *dTabNext, double dFrac, double dAmplitude) {
+	for(int32_t n = 0; n < numTaps; n++)
+		dBuffer[n] += dAmplitude * LERP(dTab[n], dTabNext[n], dFrac);
+}
 #endif
-	{
-		for(i = 0; i < sampleBlockLength; i++) {
-			POST_MIX_STAGE_1
 
+#ifdef MIX_SIMD_X86
+__attribute__((target("sse2")))
+static inline void constRunSSE2(double *dMix, int32_t numSamples, double dOutL, double dOutR) {
+	const __m128d vOut = _mm_set_pd(dOutR, dOutL);
+
+	for(int32_t i = 0; i < numSamples; i++) {
+		_mm_storeu_pd(dMix, _mm_add_pd(_mm_loadu_pd(dMix), vOut));
+		dMix += 2;
+	}
+}
+
+__attribute__((target("avx2")))
+static inline void constRunAVX2(double *dMix, int32_t numSamples, double dOutL, double dOutR) {
+	const __m256d vOut = _mm256_set_pd(dOutR, dOutL, dOutR, dOutL);
+
+	int32_t i = 0;
+	for(; i + 2 <= numSamples; i += 2) {
+		_mm256_storeu_pd(dMix, _mm256_add_pd(_mm256_loadu_pd(dMix), vOut));
+		dMix += 4;
+	}
+
+	if(i < numSamples)
+		_mm_storeu_pd(dMix, _mm_add_pd(_mm_loadu_pd(dMix), _mm256_castpd256_pd128(vOut)));
+}
+
+#ifdef USE_BLEP
+__attribute__((target("sse2")))
+static inline void blepRunSSE2(double *dMix, int32_t numSamples, double dSmp, double dVol, double *dBlepSmp, double *dBlepVol, double dPanL, double dPanR) {
+	const __m128d vPan = _mm_set_pd(dPanR, dPanL);
+	const __m128d vZero = _mm_setzero_pd();
+
+	int32_t i = 0;
+	for(; i + 2 <= numSamples; i += 2) {
+		const __m128d vSmp = _mm_add_pd(_mm_set1_pd(dSmp), _mm_loadu_pd(&dBlepSmp[i]));
+		const __m128d vVol = _mm_add_pd(_mm_set1_pd(dVol), _mm_loadu_pd(&dBlepVol[i]));
+		const __m128d vOut = _mm_mul_pd(vSmp, vVol);
+		_mm_storeu_pd(&dBlepSmp[i], vZero);
+		_mm_storeu_pd(&dBlepVol[i], vZero);
+
+		_mm_storeu_pd(dMix + 0, _mm_add_pd(_mm_loadu_pd(dMix + 0), _mm_mul_pd(_mm_unpacklo_pd(vOut, vOut), vPan)));
+		_mm_storeu_pd(dMix + 2, _mm_add_pd(_mm_loadu_pd(dMix + 2), _mm_mul_pd(_mm_unpackhi_pd(vOut, vOut), vPan)));
+		dMix += 4;
+	}
+
+	if(i < numSamples)
+		blepRunScalar(dMix, numSamples - i, dSmp, dVol, &dBlepSmp[i], &dBlepVol[i], dPanL, dPanR);
+}
+
+__attribute__((target("sse2")))
+static inline void blepAddSSE2(double *dBuffer, int32_t numTaps, const double *dTab, const double *dTabNext, double dFrac, double dAmplitude) {
+	const __m128d vFrac = _mm_set1_pd(dFrac);
+	const __m128d vAmp = _mm_set1_pd(dAmplitude);
+
+	int32_t n = 0;
+	for(; n + 2 <= numTaps; n += 2) {
+		const __m128d vTab = _mm_loadu_pd(&dTab[n]);
+		const __m128d vLerp = _mm_add_pd(vTab, _mm_mul_pd(_mm_sub_pd(_mm_loadu_pd(&dTabNext[n]), vTab), vFrac));
+		_mm_storeu_pd(&dBuffer[n], _mm_add_pd(_mm_loadu_pd(&dBuffer[n]), _mm_mul_pd(vAmp, vLerp)));
+	}
+
+	if(n < numTaps)
+		blepAddScalar(&dBuffer[n], numTaps - n, &dTab[n], &dTabNext[n], dFrac, dAmplitude);
+}
+
+__attribute__((target("avx2")))
+static inline void blepRunAVX2(double *dMix, int32_t numSamples, double dSmp, double dVol, double *dBlepSmp, double *dBlepVol, double dPanL, double dPanR) {
+	const __m256d vPan = _mm256_set_pd(dPanR, dPanL, dPanR, dPanL);
+	const __m256d vZero = _mm256_setzero_pd();
+
+	int32_t i = 0;
+	for(; i + 4 <= numSamples; i += 4) {
+		const __m256d vSmp = _mm256_add_pd(_mm256_set1_pd(dSmp), _mm256_loadu_pd(&dBlepSmp[i]));
+		const __m256d vVol = _mm256_add_pd(_mm256_set1_pd(dVol), _mm256_loadu_pd(&dBlepVol[i]));
+		const __m256d vOut = _mm256_mul_pd(vSmp, vVol); // samples 0, 1, 2, 3
+		_mm256_storeu_pd(&dBlepSmp[i], vZero);
+		_mm256_storeu_pd(&dBlepVol[i], vZero);
+
+		const __m256d vOut01 = _mm256_permute4x64_pd(vOut, 0x50); // 0, 0, 1, 1
+		const __m256d vOut23 = _mm256_permute4x64_pd(vOut, 0xFA); // 2, 2, 3, 3
+		_mm256_storeu_pd(dMix + 0, _mm256_add_pd(_mm256_loadu_pd(dMix + 0), _mm256_mul_pd(vOut01, vPan)));
+		_mm256_storeu_pd(dMix + 4, _mm256_add_pd(_mm256_loadu_pd(dMix + 4), _mm256_mul_pd(vOut23, vPan)));
+		dMix += 8;
+	}
+
+	if(i < numSamples)
+		blepRunSSE2(dMix, numSamples - i, dSmp, dVol, &dBlepSmp[i], &dBlepVol[i], dPanL, dPanR);
+}
+
+__attribute__((target("avx2")))
+static inline void blepAddAVX2(double *dBuffer, int32_t numTaps, const double *dTab, const double *dTabNext, double dFrac, double dAmplitude) {
+	const __m256d vFrac = _mm256_set1_pd(dFrac);
+	const __m256d vAmp = _mm256_set1_pd(dAmplitude);
+
+	int32_t n = 0;
+	for(; n + 4 <= numTaps; n += 4) {
+		const __m256d vTab = _mm256_loadu_pd(&dTab[n]);
+		const __m256d vLerp = _mm256_add_pd(vTab, _mm256_mul_pd(_mm256_sub_pd(_mm256_loadu_pd(&dTabNext[n]), vTab), vFrac));
+		_mm256_storeu_pd(&dBuffer[n], _mm256_add_pd(_mm256_loadu_pd(&dBuffer[n]), _mm256_mul_pd(vAmp, vLerp)));
+	}
+
+	if(n < numTaps)
+		blepAddSSE2(&dBuffer[n], numTaps - n, &dTab[n], &dTabNext[n], dFrac, dAmplitude);
+}
+#endif
+#endif
+
+// kernel is a constant in each mixVoice*() below, so the unused paths are compiled out
+static inline __attribute__((always_inline)) void constRun(const int32_t kernel, double *dMix, int32_t numSamples, double dOutL, double dOutR) {
+#ifdef MIX_SIMD_X86
+	if(kernel == MIX_KERNEL_AVX2) {
+		constRunAVX2(dMix, numSamples, dOutL, dOutR);
+		return;
+	}
+
+	if(kernel == MIX_KERNEL_SSE2) {
+		constRunSSE2(dMix, numSamples, dOutL, dOutR);
+		return;
+	}
+#endif
+	constRunScalar(dMix, numSamples, dOutL, dOutR);
+}
+
+#ifdef USE_BLEP
+static inline __attribute__((always_inline)) void blepRunBlock(const int32_t kernel, double *dMix, int32_t numSamples, double dSmp, double dVol, double *dBlepSmp, double *dBlepVol, double dPanL, double dPanR) {
+#ifdef MIX_SIMD_X86
+	if(kernel == MIX_KERNEL_AVX2) {
+		blepRunAVX2(dMix, numSamples, dSmp, dVol, dBlepSmp, dBlepVol, dPanL, dPanR);
+		return;
+	}
+
+	if(kernel == MIX_KERNEL_SSE2) {
+		blepRunSSE2(dMix, numSamples, dSmp, dVol, dBlepSmp, dBlepVol, dPanL, dPanR);
+		return;
+	}
+#endif
+	blepRunScalar(dMix, numSamples, dSmp, dVol, dBlepSmp, dBlepVol, dPanL, dPanR);
+}
+
+static inline __attribute__((always_inline)) void blepAddTaps(const int32_t kernel, double *dBuffer, int32_t numTaps, const double *dTab, const double *dTabNext, double dFrac, double dAmplitude) {
+#ifdef MIX_SIMD_X86
+	if(kernel == MIX_KERNEL_AVX2) {
+		blepAddAVX2(dBuffer, numTaps, dTab, dTabNext, dFrac, dAmplitude);
+		return;
+	}
+
+	if(kernel == MIX_KERNEL_SSE2) {
+		blepAddSSE2(dBuffer, numTaps, dTab, dTabNext, dFrac, dAmplitude);
+		return;
+	}
+#endif
+	blepAddScalar(dBuffer, numTaps, dTab, dTabNext, dFrac, dAmplitude);
+}
+
+/* 8bitbubsy: blepVolAdd() was a simplified, faster version of blepAdd for blep'ing voice volume.
+** With the transposed table it is just blepAdd() at offset 0.0, the result is identical.
+*/
+static inline __attribute__((always_inline)) void blepAddBlock(const int32_t kernel, blep_t *b, double dOffset, double dAmplitude) {
+	double f = dOffset * BLEP_SP;
+
+	const int32_t i = (int32_t)f; // get integer part of f
+	f -= i; // remove integer part from f
+
+	// the ring buffer is split in at most two contiguous parts
+	int32_t numTaps = (BLEP_RNS + 1) - b->index;
+	if(numTaps > BLEP_NS)
+		numTaps = BLEP_NS;
+
+	blepAddTaps(kernel, &b->dBuffer[b->index], numTaps, dBlepTable[i], dBlepTable[i + 1], f, dAmplitude);
+	if(numTaps < BLEP_NS)
+		blepAddTaps(kernel, b->dBuffer, BLEP_NS - numTaps, &dBlepTable[i][numTaps], &dBlepTable[i + 1][numTaps], f, dAmplitude);
+
+	b->samplesLeft = BLEP_NS;
+}
+
+/* Runs the pending part of both BLEP buffers. The sample and volume BLEPs are always stepped
+** together, so their ring indexes stay equal. This gives the same output as stepping them one
+** by one, as a BLEP buffer with no samples left only holds zeroes.
+*/
+static inline __attribute__((always_inline)) void mixBlepRun(const int32_t kernel, paulaVoice_t *v, blep_t *bSmp, blep_t *bVol, double *dMix, int32_t numSamples, double dSmp, double dVol) {
+	while(numSamples > 0) {
+		int32_t n = (BLEP_RNS + 1) - bSmp->index; // don't cross the ring buffer end
+		if(n > numSamples)
+			n = numSamples;
+
+		blepRunBlock(kernel, dMix, n, dSmp, dVol, &bSmp->dBuffer[bSmp->index], &bVol->dBuffer[bSmp->index], v->dPanL, v->dPanR);
+
+		bSmp->index = (bSmp->index + n) & BLEP_RNS;
+		bVol->index = bSmp->index;
+		bSmp->samplesLeft = (bSmp->samplesLeft > n) ? bSmp->samplesLeft - n : 0;
+		bVol->samplesLeft = (bVol->samplesLeft > n) ? bVol->samplesLeft - n : 0;
+
+		dMix += n * 2;
+		numSamples -= n;
+	}
+}
+#endif
+
+// blep is a constant as well, false is the nearest tier
+static inline __attribute__((always_inline)) void mixVoiceKernel(const int32_t kernel, const bool blep, struct pt_state *state, int32_t ch, double *dMix, int32_t numSamples) {
+	paulaVoice_t *v = &state->paula[ch];
+#ifdef USE_BLEP
+	blep_t *bSmp = &state->blep[ch];
+	blep_t *bVol = &state->blepVol[ch];
+#endif
+
+	while(numSamples > 0) {
+		// sample and volume can only change on a phase wrap (or between two mixAudio() calls)
+		const double dSmp = v->data[v->pos] * (1.0 / 128.0);
+		const double dVol = v->dVolume;
+
+#ifdef USE_BLEP
+		if(blep && dSmp != bSmp->dLastValue) {
+			if(v->dLastDelta > v->dLastPhase) {
+				// div->mul trick: v->dLastDeltaMul is 1.0 / v->dLastDelta
+				blepAddBlock(kernel, bSmp, v->dLastPhase * v->dLastDeltaMul, bSmp->dLastValue - dSmp);
+			}
+
+			bSmp->dLastValue = dSmp;
+		}
+
+		if(blep && dVol != bVol->dLastValue) {
+			blepAddBlock(kernel, bVol, 0.0, bVol->dLastValue - dVol);
+			bVol->dLastValue = dVol;
+		}
+#endif
+
+		// find the length of this run, the phase is stepped exactly like Paula's per-sample loop did
+		double dPhase = v->dPhase;
+		bool wrapped = false;
+		int32_t runLength = 0;
+		while(runLength < numSamples) {
+			runLength++;
+
+			dPhase += v->dDelta;
+			if(dPhase >= 1.0) {
+				wrapped = true;
+				break;
+			}
+		}
+
+		// the level is the same for the whole run (the BLEP ramps are left out), so the meter costs nothing per sample
+		const double dLevel = fabs(dSmp * dVol);
+		if(dLevel > v->dMeterPeak)
+			v->dMeterPeak = dLevel;
+		v->dMeterSumSq += dLevel * dLevel * runLength;
+
+		int32_t constLength = runLength;
+#ifdef USE_BLEP
+		int32_t blepLength = (bSmp->samplesLeft > bVol->samplesLeft) ? bSmp->samplesLeft : bVol->samplesLeft;
+		if(blepLength > runLength)
+			blepLength = runLength;
+
+		if(blep && blepLength > 0) {
+			mixBlepRun(kernel, v, bSmp, bVol, dMix, blepLength, dSmp, dVol);
+			constLength -= blepLength;
+		}
+#endif
+		if(constLength > 0) {
+			const double dOut = dSmp * dVol;
+			constRun(kernel, dMix + ((runLength - constLength) * 2), constLength, dOut * v->dPanL, dOut * v->dPanR);
+		}
+
+		dMix += runLength * 2;
+		numSamples -= runLength;
+
+		if(wrapped) {
+			dPhase -= 1.0;
+#ifdef USE_BLEP
+			v->dLastPhase = dPhase;
+			v->dLastDelta = v->dDelta;
+			v->dLastDeltaMul = v->dDeltaMul;
+#endif
+			if(++v->pos >= v->length) {
+				v->pos = 0;
+
+				// re-fetch Paula register values now
+				v->length = v->newLength;
+				v->data = v->newData;
+			}
+
+			pushHistory(v);
+		}
+
+		v->dPhase = dPhase;
+	}
+}
+
+/* The linear and sinc tiers. The output changes every sample, so there are no runs; the level
+** meter is also updated per sample.
+*/
+static inline __attribute__((always_inline)) void mixVoiceInterpolated(const int32_t taps, struct pt_state *state, int32_t ch, double *dMix, int32_t numSamples) {
+	paulaVoice_t *v = &state->paula[ch];
+	const double dVol = v->dVolume;
+	const double dVolL = dVol * v->dPanL;
+	const double dVolR = dVol * v->dPanR;
+	double dPhase = v->dPhase;
+
+	for(int32_t i = 0; i < numSamples; i++) {
+		const double *dTaps = &v->dHistory[v->historyIndex + 1 + (SINC_TAPS - taps)]; // oldest first
+		double dSmp;
+
+		if(taps == 2) {
+			dSmp = dTaps[0] + ((dTaps[1] - dTaps[0]) * dPhase);
+		} else {
+			double f = dPhase * SINC_PHASES;
+			const int32_t p = (int32_t)f;
+			f -= p;
+
+			const double *dTab = dSincTable[p];
+			const double *dTabNext = dSincTable[p + 1];
+
+			dSmp = 0.0;
+			for(int32_t n = 0; n < SINC_TAPS; n++)
+				dSmp += dTaps[n] * (dTab[n] + ((dTabNext[n] - dTab[n]) * f));
+		}
+
+		dMix[0] += dSmp * dVolL;
+		dMix[1] += dSmp * dVolR;
+		dMix += 2;
+
+		const double dLevel = fabs(dSmp * dVol);
+		if(dLevel > v->dMeterPeak)
+			v->dMeterPeak = dLevel;
+		v->dMeterSumSq += dLevel * dLevel;
+
+		dPhase += v->dDelta;
+		if(dPhase >= 1.0) {
+			dPhase -= 1.0;
+			if(++v->pos >= v->length) {
+				v->pos = 0;
+
+				// re-fetch Paula register values now
+				v->length = v->newLength;
+				v->data = v->newData;
+			}
+
+			pushHistory(v);
+		}
+	}
+
+	v->dPhase = dPhase;
+}
+
+static inline __attribute__((always_inline)) void mixVoiceTier(const int32_t kernel, struct pt_state *state, int32_t ch, double *dMix, int32_t numSamples) {
+	switch(state->interpolation) {
+		case INTERPOLATION_LINEAR: mixVoiceInterpolated(2, state, ch, dMix, numSamples); break;
+		case INTERPOLATION_SINC:   mixVoiceInterpolated(SINC_TAPS, state, ch, dMix, numSamples); break;
+#ifdef USE_BLEP
+		case INTERPOLATION_BLEP:   mixVoiceKernel(kernel, true, state, ch, dMix, numSamples); break;
+#endif
+		default:                   mixVoiceKernel(kernel, false, state, ch, dMix, numSamples); break;
+	}
+}
+
+static void mixVoiceScalar(struct pt_state *state, int32_t ch, double *dMix, int32_t numSamples) {
+	mixVoiceTier(MIX_KERNEL_SCALAR, state, ch, dMix, numSamples);
+}
+
+#ifdef MIX_SIMD_X86
+__attribute__((target("sse2")))
+static void mixVoiceSSE2(struct pt_state *state, int32_t ch, double *dMix, int32_t numSamples) {
+	mixVoiceTier(MIX_KERNEL_SSE2, state, ch, dMix, numSamples);
+}
+
+__attribute__((target("avx2")))
+static void mixVoiceAVX2(struct pt_state *state, int32_t ch, double *dMix, int32_t numSamples) {
+	mixVoiceTier(MIX_KERNEL_AVX2, state, ch, dMix, numSamples);
+}
+#endif
+
+static void (*mixVoice)(struct pt_state *state, int32_t ch, double *dMix, int32_t numSamples) = mixVoiceScalar;
+
+/* POST-MIX FILTERS
+** The RC low-pass, the "LED" filter and the RC high-pass run fused, over a whole block at a time,
+** and write straight to the output. The filter states stay in locals (in registers) for the block.
+** The SSE2 version keeps left and right in the two lanes of a register, which is the same math as
+** the scalar version, in the same order, so both give the same output.
+**
+** The filtered and normalized frames go back into dMixBuffer, outputBlock[] then writes them out in
+** the output format, several samples at a time.
+**
+** Denormals: the filters decay towards zero in silence. On x86 mixAudio() runs them with
+** flush-to-zero and denormals-are-zero set, elsewhere the states are flushed after each block.
+*/
+typedef struct postMixState_t {
+	double lo[2], led[4], hi[2];
+} postMixState_t;
+
+// all filters that are compiled out are left out here as well
+static inline __attribute__((always_inline)) void postMixLoad(struct pt_state *state, postMixState_t *p) {
+#ifdef USE_LOWPASS
+	memcpy(p->lo, state->filterLo.buffer, sizeof(p->lo));
+#endif
+#ifdef LED_FILTER
+	memcpy(p->led, state->filterLED.buffer, sizeof(p->led));
+#endif
+#ifdef USE_HIGHPASS
+	memcpy(p->hi, state->filterHi.buffer, sizeof(p->hi));
+#endif
+	(void)state;
+	(void)p;
+}
+
+static inline __attribute__((always_inline)) void postMixStore(struct pt_state *state, const postMixState_t *p) {
 #ifdef USE_LOWPASS
-			RCLowPassFilter(&state->filterLo, dOut, dOut);
+	memcpy(state->filterLo.buffer, p->lo, sizeof(p->lo));
+#endif
+#ifdef LED_FILTER
+	memcpy(state->filterLED.buffer, p->led, sizeof(p->led));
+#endif
+#ifdef USE_HIGHPASS
+	memcpy(state->filterHi.buffer, p->hi, sizeof(p->hi));
 #endif
+	(void)state;
+	(void)p;
+}
+
+// led is a constant in each instance, so the LED filter is compiled out of the other one
+static inline __attribute__((always_inline)) void postMixScalar(const bool led, struct pt_state *state, int32_t numSamples) {
+	postMixState_t p;
+	postMixLoad(state, &p);
+
+	for(int32_t i = 0; i < numSamples; i++) {
+		double dOut[2];
+		dOut[0] = state->dMixBuffer[(i * 2) + 0];
+		dOut[1] = state->dMixBuffer[(i * 2) + 1];
 
+		for(int32_t ch = 0; ch < 2; ch++) {
+			double in = dOut[ch];
+#ifdef USE_LOWPASS
+			{
+				const rcFilter_t *f = &state->filterLo;
+				const double y = (p.lo[ch] * f->g) + (in * f->cg);
+				p.lo[ch] += (in - y) * f->c2;
+				in = y;
+			}
+#endif
+#ifdef LED_FILTER
+			if(led) {
+				const ledFilter_t *f = &state->filterLED;
+				double *v = &p.led[ch * 2];
+
+				const double estimate = f->ci * (v[1] + (f->c * (f->ci * (v[0] + (f->c * in)))));
+				const double y0 = (v[0] * f->ci) + (in * f->cg) + (estimate * f->bg);
+				const double y1 = (v[1] * f->ci) + (y0 * f->cg);
+
+				v[0] += f->c2 * (in - y0);
+				v[1] += f->c2 * (y0 - y1);
+				in = y1;
+			}
+#endif
+#ifdef USE_HIGHPASS
+			{
+				const rcFilter_t *f = &state->filterHi;
+				const double low = (p.hi[ch] * f->g) + (in * f->cg);
+				p.hi[ch] += (in - low) * f->c2;
+				in -= low;
+			}
+#endif
+			// normalize and flip phase (A500/A1200 has an inverted audio signal)
+			state->dMixBuffer[(i * 2) + ch] = in * (-INT16_MAX / (double)AMIGA_VOICES);
+		}
+	}
+
+	postMixStore(state, &p);
+	(void)led;
+}
+
+#ifdef MIX_SIMD_X86
+__attribute__((target("sse2")))
+static inline __attribute__((always_inline)) void postMixSSE2(const bool led, struct pt_state *state, int32_t numSamples) {
+	postMixState_t p;
+	postMixLoad(state, &p);
+
+#ifdef USE_LOWPASS
+	const __m128d loG = _mm_set1_pd(state->filterLo.g), loCG = _mm_set1_pd(state->filterLo.cg), loC2 = _mm_set1_pd(state->filterLo.c2);
+	__m128d lo = _mm_loadu_pd(p.lo);
+#endif
+#ifdef LED_FILTER
+	const ledFilter_t *f = &state->filterLED;
+	const __m128d ledC = _mm_set1_pd(f->c), ledG = _mm_set1_pd(f->ci), ledCG = _mm_set1_pd(f->cg), ledBG = _mm_set1_pd(f->bg), ledC2 = _mm_set1_pd(f->c2);
+	__m128d led0 = _mm_set_pd(p.led[2], p.led[0]); // first stage, L and R
+	__m128d led1 = _mm_set_pd(p.led[3], p.led[1]); // second stage
+#endif
 #ifdef USE_HIGHPASS
-			RCHighPassFilter(&state->filterHi, dOut, dOut);
+	const __m128d hiG = _mm_set1_pd(state->filterHi.g), hiCG = _mm_set1_pd(state->filterHi.cg), hiC2 = _mm_set1_pd(state->filterHi.c2);
+	__m128d hi = _mm_loadu_pd(p.hi);
 #endif
+	const __m128d normalize = _mm_set1_pd(-INT16_MAX / (double)AMIGA_VOICES);
 
-			POST_MIX_STAGE_2
+	for(int32_t i = 0; i < numSamples; i++) {
+		__m128d in = _mm_loadu_pd(&state->dMixBuffer[i * 2]);
+#ifdef USE_LOWPASS
+		{
+			const __m128d y = _mm_add_pd(_mm_mul_pd(lo, loG), _mm_mul_pd(in, loCG));
+			lo = _mm_add_pd(lo, _mm_mul_pd(_mm_sub_pd(in, y), loC2));
+			in = y;
+		}
+#endif
+#ifdef LED_FILTER
+		if(led) {
+			const __m128d estimate = _mm_mul_pd(ledG, _mm_add_pd(led1, _mm_mul_pd(ledC, _mm_mul_pd(ledG, _mm_add_pd(led0, _mm_mul_pd(ledC, in))))));
+			const __m128d y0 = _mm_add_pd(_mm_add_pd(_mm_mul_pd(led0, ledG), _mm_mul_pd(in, ledCG)), _mm_mul_pd(estimate, ledBG));
+			const __m128d y1 = _mm_add_pd(_mm_mul_pd(led1, ledG), _mm_mul_pd(y0, ledCG));
+
+			led0 = _mm_add_pd(led0, _mm_mul_pd(ledC2, _mm_sub_pd(in, y0)));
+			led1 = _mm_add_pd(led1, _mm_mul_pd(ledC2, _mm_sub_pd(y0, y1)));
+			in = y1;
 		}
+#endif
+#ifdef USE_HIGHPASS
+		{
+			const __m128d low = _mm_add_pd(_mm_mul_pd(hi, hiG), _mm_mul_pd(in, hiCG));
+			hi = _mm_add_pd(hi, _mm_mul_pd(_mm_sub_pd(in, low), hiC2));
+			in = _mm_sub_pd(in, low);
+		}
+#endif
+		_mm_storeu_pd(&state->dMixBuffer[i * 2], _mm_mul_pd(in, normalize));
+	}
+
+#ifdef USE_LOWPASS
+	_mm_storeu_pd(p.lo, lo);
+#endif
+#ifdef LED_FILTER
+	_mm_storel_pd(&p.led[0], led0);
+	_mm_storel_pd(&p.led[1], led1);
+	_mm_storeh_pd(&p.led[2], led0);
+	_mm_storeh_pd(&p.led[3], led1);
+#endif
+#ifdef USE_HIGHPASS
+	_mm_storeu_pd(p.hi, hi);
+#endif
+	postMixStore(state, &p);
+	(void)led;
+}
+#endif
+
+static void postMixPlain(struct pt_state *state, int32_t numSamples) {
+	postMixScalar(false, state, numSamples);
+}
+
+static void postMixLED(struct pt_state *state, int32_t numSamples) {
+	postMixScalar(true, state, numSamples);
+}
+
+#ifdef MIX_SIMD_X86
+__attribute__((target("sse2")))
+static void postMixPlainSSE2(struct pt_state *state, int32_t numSamples) {
+	postMixSSE2(false, state, numSamples);
+}
+
+__attribute__((target("sse2")))
+static void postMixLEDSSE2(struct pt_state *state, int32_t numSamples) {
+	postMixSSE2(true, state, numSamples);
+}
+#endif
+
+// [0] without the LED filter, [1] with it
+static void (*postMix[2])(struct pt_state *state, int32_t numSamples) = { postMixPlain, postMixLED };
+
+/* Output formats. The SIMD versions do four stereo frames at a time and leave the rest to the
+** scalar ones, with the same math in the same order, so the output doesn't depend on the CPU.
+*/
+// samples first..last-1 of the mixbuffer (L and R counted apart)
+static inline void ditherInt16(struct pt_state *state, int16_t *out, int32_t first, int32_t last) {
+	for(int32_t i = first; i < last; i++) {
+		const uint32_t n = state->ditherPos + i;
+
+		// 1-bit triangular dithering (high-pass filtered)
+		const double dPrng = ditherHash(n) * (0.5 / INT32_MAX); // -0.5..0.5
+		const double dPrngLast = ditherHash(n - 2) * (0.5 / INT32_MAX);
+
+		int32_t smp32 = (int32_t)((state->dMixBuffer[i] + dPrng) - dPrngLast);
+		smp32 = (smp32 * state->masterVol) >> 8;
+		CLAMP16(smp32);
+		out[i] = (int16_t)smp32;
+	}
+}
+
+static void outputInt16(struct pt_state *state, void *stream, int32_t numSamples) {
+	ditherInt16(state, (int16_t *)stream, 0, numSamples * 2);
+	state->ditherPos += numSamples * 2;
+}
+
+static void outputInt32(struct pt_state *state, void *stream, int32_t numSamples) {
+	const double dScale = state->masterVol * (65536.0 / 256.0);
+	int32_t *out = (int32_t *)stream;
+
+	for(int32_t i = 0; i < numSamples * 2; i++) {
+		const double dSmp = state->dMixBuffer[i] * dScale;
+		out[i] = (int32_t)CLAMP(dSmp, (double)INT32_MIN, (double)INT32_MAX);
+	}
+}
+
+static void outputFloat32(struct pt_state *state, void *stream, int32_t numSamples) {
+	const double dScale = state->masterVol * (1.0 / (256.0 * 32768.0));
+	float *out = (float *)stream;
+
+	for(int32_t i = 0; i < numSamples * 2; i++)
+		out[i] = (float)(state->dMixBuffer[i] * dScale);
+}
+
+#ifdef MIX_SIMD_X86
+__attribute__((target("avx2")))
+static void outputInt16AVX2(struct pt_state *state, void *stream, int32_t numSamples) {
+	const __m256d dDitherScale = _mm256_set1_pd(0.5 / INT32_MAX);
+	const __m128i vol = _mm_set1_epi32(state->masterVol);
+	const double *dMix = state->dMixBuffer;
+	int16_t *out = (int16_t *)stream;
+	int32_t i = 0;
+
+	__m256i n = _mm256_add_epi32(_mm256_set1_epi32((int32_t)state->ditherPos), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+	for(; i + 8 <= numSamples * 2; i += 8) {
+		const __m256i prng = ditherHashAVX2(n);
+		const __m256i prngLast = ditherHashAVX2(_mm256_sub_epi32(n, _mm256_set1_epi32(2)));
+		n = _mm256_add_epi32(n, _mm256_set1_epi32(8));
+
+		__m256d lo = _mm256_add_pd(_mm256_loadu_pd(&dMix[i + 0]), _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(prng)), dDitherScale));
+		__m256d hi = _mm256_add_pd(_mm256_loadu_pd(&dMix[i + 4]), _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(prng, 1)), dDitherScale));
+		lo = _mm256_sub_pd(lo, _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(prngLast)), dDitherScale));
+		hi = _mm256_sub_pd(hi, _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(prngLast, 1)), dDitherScale));
+
+		// truncate, master volume, and the saturating pack is CLAMP16()
+		const __m128i smpLo = _mm_srai_epi32(_mm_mullo_epi32(_mm256_cvttpd_epi32(lo), vol), 8);
+		const __m128i smpHi = _mm_srai_epi32(_mm_mullo_epi32(_mm256_cvttpd_epi32(hi), vol), 8);
+		_mm_storeu_si128((__m128i *)&out[i], _mm_packs_epi32(smpLo, smpHi));
+	}
+
+	ditherInt16(state, out, i, numSamples * 2);
+	state->ditherPos += numSamples * 2;
+}
+
+__attribute__((target("avx2")))
+static void outputInt32AVX2(struct pt_state *state, void *stream, int32_t numSamples) {
+	const __m256d dScale = _mm256_set1_pd(state->masterVol * (65536.0 / 256.0));
+	const __m256d dMin = _mm256_set1_pd((double)INT32_MIN), dMax = _mm256_set1_pd((double)INT32_MAX);
+	int32_t *out = (int32_t *)stream;
+	int32_t i = 0;
+
+	for(; i + 4 <= numSamples * 2; i += 4) {
+		const __m256d dSmp = _mm256_mul_pd(_mm256_loadu_pd(&state->dMixBuffer[i]), dScale);
+		_mm_storeu_si128((__m128i *)&out[i], _mm256_cvttpd_epi32(_mm256_min_pd(_mm256_max_pd(dSmp, dMin), dMax)));
+	}
+
+	for(; i < numSamples * 2; i++) {
+		const double dSmp = state->dMixBuffer[i] * (state->masterVol * (65536.0 / 256.0));
+		out[i] = (int32_t)CLAMP(dSmp, (double)INT32_MIN, (double)INT32_MAX);
+	}
+}
+
+__attribute__((target("avx2")))
+static void outputFloat32AVX2(struct pt_state *state, void *stream, int32_t numSamples) {
+	const __m256d dScale = _mm256_set1_pd(state->masterVol * (1.0 / (256.0 * 32768.0)));
+	float *out = (float *)stream;
+	int32_t i = 0;
+
+	for(; i + 4 <= numSamples * 2; i += 4)
+		_mm_storeu_ps(&out[i], _mm256_cvtpd_ps(_mm256_mul_pd(_mm256_loadu_pd(&state->dMixBuffer[i]), dScale)));
+
+	for(; i < numSamples * 2; i++)
+		out[i] = (float)(state->dMixBuffer[i] * (state->masterVol * (1.0 / (256.0 * 32768.0))));
+}
+#endif
+
+static void (*outputBlock[OUTPUT_FORMAT_COUNT])(struct pt_state *state, void *stream, int32_t numSamples) = { outputInt16, outputInt32, outputFloat32 };
+
+#ifndef MIX_SIMD_X86
+static inline double flushDenormal(double x) {
+	return (fabs(x) < 1e-30) ? 0.0 : x;
+}
+
+static void flushFilterDenormals(struct pt_state *state) {
+#ifdef USE_LOWPASS
+	for(int32_t i = 0; i < 2; i++)
+		state->filterLo.buffer[i] = flushDenormal(state->filterLo.buffer[i]);
+#endif
+#ifdef LED_FILTER
+	for(int32_t i = 0; i < 4; i++)
+		state->filterLED.buffer[i] = flushDenormal(state->filterLED.buffer[i]);
+#endif
+#ifdef USE_HIGHPASS
+	for(int32_t i = 0; i < 2; i++)
+		state->filterHi.buffer[i] = flushDenormal(state->filterHi.buffer[i]);
+#endif
+	(void)state;
+}
+#endif
+
+static void mixAudio(struct pt_state *state, void *stream, int32_t sampleBlockLength) {
+	state->samplePos += sampleBlockLength;
+	memset(state->dMixBuffer, 0, sampleBlockLength * (sizeof(double) * 2));
+
+	if(state->musicPaused) {
+		memset(stream, 0, sampleBlockLength * outputFrameSize(state->outputFormat));
+		return;
+	}
+
+	for(int32_t i = 0; i < AMIGA_VOICES; i++) {
+		if(state->paula[i].active)
+			mixVoice(state, i, state->dMixBuffer, sampleBlockLength);
+	}
+
+#ifdef LED_FILTER
+	const int32_t led = state->LEDFilterOn;
+#else
+	const int32_t led = 0;
+#endif
+
+#ifdef MIX_SIMD_X86
+	// flush-to-zero and denormals-are-zero, for the filters only, the caller's setting is put back
+	const uint32_t csr = _mm_getcsr();
+	_mm_setcsr(csr | 0x8040);
+	postMix[led](state, sampleBlockLength);
+	_mm_setcsr(csr);
+#else
+	postMix[led](state, sampleBlockLength);
+	flushFilterDenormals(state);
+#endif
+
+	outputBlock[state->outputFormat](state, stream, sampleBlockLength);
+}
+#endif
+
+static void initMixer(void) {
+#ifdef USE_BLEP
+	initBlepTable();
+#endif
+
+#ifndef USE_FIXEDPOINT
+	initSincTable();
+#endif
+
+#ifdef MIX_SIMD_X86
+	__builtin_cpu_init();
+
+	if(__builtin_cpu_supports("avx2"))
+		mixVoice = mixVoiceAVX2;
+	else if(__builtin_cpu_supports("sse2"))
+		mixVoice = mixVoiceSSE2;
+
+#ifndef USE_FIXEDPOINT
+	if(__builtin_cpu_supports("sse2")) {
+		postMix[0] = postMixPlainSSE2;
+		postMix[1] = postMixLEDSSE2;
 	}
+
+	if(__builtin_cpu_supports("avx2")) {
+		outputBlock[OUTPUT_INT16] = outputInt16AVX2;
+		outputBlock[OUTPUT_INT32] = outputInt32AVX2;
+		outputBlock[OUTPUT_FLOAT32] = outputFloat32AVX2;
+	}
+#endif
+#endif
 }
 
 static void pt2play_PauseSong(struct pt_state *state, bool flag) {
@@ -1629,6 +3036,22 @@ static void pt2play_TogglePause(struct pt_state *state) {
 }
 
 static void pt2play_Close(struct pt_state *state) {
+	state->SongPlaying = false;
+
+	if(state->checkpoints != NULL) {
+		free(state->checkpoints);
+		state->checkpoints = NULL;
+	}
+
+	if(state->PatternData != NULL) {
+		free(state->PatternData);
+		state->PatternData = NULL;
+	}
+
+	if(state->SampleData != NULL) {
+		free(state->SampleData);
+		state->SampleData = NULL;
+	}
 }
 
 static uint16_t bpm2SmpsPerTick(uint32_t bpm, uint32_t audioFreq) {
@@ -1644,31 +3067,90 @@ static uint16_t bpm2SmpsPerTick(uint32_t bpm, uint32_t audioFreq) {
 	return (uint16_t)((audioFreq * dFreqMul) + 0.5);
 }
 
-static void pt2play_initPlayer(uint32_t samplerate) {
-	for(uint32_t i = 32; i <= 255; i++) {
-		bpmTab[i - 32] = bpm2SmpsPerTick(i, samplerate);
-	}
+// later calls do nothing, the tables and mixer kernels may be in use by players on other threads by then
+static void pt2play_initPlayer(uint32_t samplerate) {
+	static bool initialized;
+	if(initialized)
+		return;
+
+	(void)samplerate; // the rate is set per player by pt2play_PlaySong(), the tables here don't depend on it
+	initPeriodNoteTable();
+	initMixer();
+	initialized = true;
+}
+
+// the song as pt2play_PlaySong() starts it, without decoding the module again
+static void rewindSong(struct pt_state *state) {
+	// no channel state from a previous song (funk, loops, vibrato...) must leak into this one
+	memset(state->ChanTemp, 0, sizeof(state->ChanTemp));
+	for(int32_t i = 0; i < AMIGA_VOICES; i++)
+		state->ChanTemp[i].n_chanindex = (int8_t)i;
+
+	memset(state->paula, 0, sizeof(state->paula));
+	calculatePans(state, state->stereoSep);
+	memset(state->channelInfo, 0, sizeof(state->channelInfo));
+
+#ifdef USE_BLEP
+	memset(state->blep, 0, sizeof(state->blep));
+	memset(state->blepVol, 0, sizeof(state->blepVol));
+#endif
+
+#ifdef USE_LOWPASS
+	clearRCFilterState(&state->filterLo);
+#endif
+
+#ifdef LED_FILTER
+	clearLEDFilterState(state);
+	state->LEDFilterOn = false;
+#endif
+
+#ifdef USE_HIGHPASS
+	clearRCFilterState(&state->filterHi);
+#endif
+
+	resetAudioDithering(state);
+
+	state->samplePos = 0;
+	state->tickPos = 0;
+	state->rowSongPos = 0;
+	state->rowPattPos = 0;
+	state->samplesPerTickLeft = 0;
+	state->CurrSpeed = 6;
+	state->Counter = 0;
+	state->SongPosition = 0;
+	state->PatternPos = 0;
+	state->PattDelTime = 0;
+	state->PattDelTime2 = 0;
+	state->PBreakPosition = 0;
+	state->PosJumpAssert = false;
+	state->PBreakFlag = false;
+	state->SetBPMFlag = 0;
+	state->LowMask = 0xFF;
+	state->SongPlaying = true;
+
+	SetReplayerBPM(state, 125);
 }
 
-static bool pt2play_PlaySong(struct pt_state *state, uint8_t *moduleData, int8_t tempoMode, uint32_t audioFreq) {
+static bool pt2play_PlaySong(struct pt_state *state, const uint8_t *moduleData, int8_t tempoMode, uint32_t audioFreq) {
 	state->stereoSep = STEREO_SEP;
-	state->randSeed = INITIAL_DITHER_SEED;
 	state->masterVol = 256;
+	if(!state->interpolationSet)
+		state->interpolation = DEFAULT_INTERPOLATION;
 
 	state->musicPaused = true;
 
 	pt2play_Close(state);
 
-	state->oldPeriod = -1;
-	state->sampleCounter = 0;
-	state->SongPlaying = false;
-
 	// rates below 32kHz will mess up the BLEP synthesis
 	audioFreq = CLAMP(audioFreq, 32000, 96000);
 
 	state->audioRate = audioFreq;
 	state->dPeriodToDeltaDiv = (double)PAULA_PAL_CLK / state->audioRate;
-	state->soundBufferSize = MIX_BUF_SAMPLES;
+	initPeriodDeltaTable(state);
+
+	for(uint32_t i = 32; i <= 255; i++) {
+		state->bpmTab[i - 32] = bpm2SmpsPerTick(i, state->audioRate);
+	}
 
 #if defined(USE_HIGHPASS) || defined(USE_LOWPASS)
 	double R, C, fc;
@@ -1708,83 +3190,259 @@ static bool pt2play_PlaySong(struct pt_state *state, uint8_t *moduleData, int8_t
 		return false;
 	}
 
-	memset(state->paula, 0, sizeof(state->paula));
+	rewindSong(state);
+	state->TempoMode = tempoMode ? VBLANK_TEMPO_MODE : CIA_TEMPO_MODE;
+	state->musicPaused = false;
+	return true;
+}
+
+static void pt2play_SetStereoSep(struct pt_state *state, uint8_t percentage) {
+	state->stereoSep = percentage;
+	if(state->stereoSep > 100)
+		state->stereoSep = 100;
+
 	calculatePans(state, state->stereoSep);
+}
+
+static void pt2play_SetMasterVol(struct pt_state *state, uint16_t vol) {
+	state->masterVol = CLAMP(vol, 0, 256);
+}
+
+static uint16_t pt2play_GetMasterVol(struct pt_state *state) {
+	return (uint16_t)state->masterVol;
+}
 
 #ifdef USE_BLEP
+// nothing pending, and the last values are what the voices play now, so the next change makes the first step
+static void restartBleps(struct pt_state *state) {
 	memset(state->blep, 0, sizeof(state->blep));
 	memset(state->blepVol, 0, sizeof(state->blepVol));
-#endif
 
-#ifdef USE_LOWPASS
-	clearRCFilterState(&state->filterLo);
+	for(int32_t i = 0; i < AMIGA_VOICES; i++) {
+		const paulaVoice_t *v = &state->paula[i];
+		if(!v->active || v->data == NULL)
+			continue;
+
+#ifdef USE_FIXEDPOINT
+		state->blep[i].lastValue = v->data[v->pos] << 9;
+		state->blepVol[i].lastValue = v->volume;
+#else
+		state->blep[i].dLastValue = v->data[v->pos] * (1.0 / 128.0);
+		state->blepVol[i].dLastValue = v->dVolume;
+#endif
+	}
+}
 #endif
 
-#ifdef LED_FILTER
-	clearLEDFilterState(state);
+/* Picks the resampling, INTERPOLATION_*, DEFAULT_INTERPOLATION until this is called. It is kept by
+** pt2play_PlaySong(), like the output format. Returns false for a tier this build doesn't have: BLEP
+** needs USE_BLEP, and the fixed-point mixer only has DEFAULT_INTERPOLATION.
+*/
+static bool pt2play_SetInterpolation(struct pt_state *state, int8_t interpolation) {
+#ifdef USE_FIXEDPOINT
+	if(interpolation != DEFAULT_INTERPOLATION)
+		return false;
+#else
+	if(interpolation < 0 || interpolation >= INTERPOLATION_COUNT)
+		return false;
 #endif
 
-#ifdef USE_HIGHPASS
-	clearRCFilterState(&state->filterHi);
+#ifdef USE_BLEP
+	// whatever is pending is from the last time BLEP was used
+	if(interpolation == INTERPOLATION_BLEP && state->interpolation != INTERPOLATION_BLEP)
+		restartBleps(state);
+#else
+	if(interpolation == INTERPOLATION_BLEP)
+		return false;
 #endif
 
-	resetAudioDithering(state);
+	state->interpolation = interpolation;
+	state->interpolationSet = true;
+	return true;
+}
 
-	state->CurrSpeed = 6;
-	state->Counter = 0;
-	state->SongPosition = 0;
-	state->PatternPos = 0;
-	state->PattDelTime = 0;
-	state->PattDelTime2 = 0;
-	state->PBreakPosition = 0;
-	state->PosJumpAssert = false;
-	state->PBreakFlag = false;
-	state->LowMask = 0xFF;
-	state->TempoMode = tempoMode ? VBLANK_TEMPO_MODE : CIA_TEMPO_MODE;
-	state->SongPlaying = true;
-	state->musicPaused = false;
+static int8_t pt2play_GetInterpolation(struct pt_state *state) {
+	return state->interpolation;
+}
 
-#ifdef LED_FILTER
-	state->LEDFilterOn = false;
-#endif
+/* OUTPUT_*, for the buffers given to pt2play_FillAudioBuffer() from now on. It is kept by
+** pt2play_PlaySong(), as it belongs to the audio device rather than to the song.
+*/
+static bool pt2play_SetOutputFormat(struct pt_state *state, int8_t format) {
+	if(format < 0 || format >= OUTPUT_FORMAT_COUNT)
+		return false;
 
-	SetReplayerBPM(state, 125);
-	state->musicPaused = false;
+	state->outputFormat = format;
 	return true;
 }
 
-static void pt2play_SetStereoSep(struct pt_state *state, uint8_t percentage) {
-	state->stereoSep = percentage;
-	if(state->stereoSep > 100)
-		state->stereoSep = 100;
+static uint32_t pt2play_GetMixerTicks(struct pt_state *state) {
+	if(state->audioRate <= 0)
+		return 0;
 
-	calculatePans(state, state->stereoSep);
+	return (uint32_t)((state->samplePos * 1000) / state->audioRate); // not audioRate / 1000, that drifts at 44.1kHz
 }
 
-static void pt2play_SetMasterVol(struct pt_state *state, uint16_t vol) {
-	state->masterVol = CLAMP(vol, 0, 256);
+/* Sample-accurate song clock, as of the last mixed sample. The row being played, including how far
+** into it, is (row + ((tick + ((samplePos - tickPos) / samplesPerTick)) / speed)). Times are in
+** samplePos, like channelInfo_t::triggerPos.
+*/
+typedef struct pt2Clock_t {
+	uint64_t samplePos; // stereo frames mixed since pt2play_PlaySong(), or the song time after pt2play_Seek()
+	uint64_t tickPos; // samplePos where the current tick started
+	int32_t audioRate;
+	int32_t samplesPerTick; // of the current tick
+	uint8_t songPosition, row; // the row being played
+	uint8_t tick, speed; // tick is 0..speed-1
+} pt2Clock_t;
+
+static void pt2play_GetClock(struct pt_state *state, pt2Clock_t *clock) {
+	clock->samplePos = state->samplePos;
+	clock->tickPos = state->tickPos;
+	clock->audioRate = state->audioRate;
+	clock->samplesPerTick = state->samplesPerTick;
+	clock->songPosition = state->rowSongPos;
+	clock->row = state->rowPattPos;
+	clock->tick = state->Counter;
+	clock->speed = state->CurrSpeed;
+}
+
+// turns what the mixer measured since the last call into channelInfo[].peak/rms, and starts over
+static void updateMeters(struct pt_state *state, int32_t samples) {
+	for(int32_t i = 0; i < AMIGA_VOICES; i++) {
+		paulaVoice_t *v = &state->paula[i];
+		channelInfo_t *info = &state->channelInfo[i];
+
+#ifdef USE_FIXEDPOINT
+		info->peak = v->meterPeak * (1.0f / 65536.0f);
+		info->rms = (samples > 0) ? (float)sqrt((double)v->meterSumSq / samples) * (1.0f / 65536.0f) : 0.0f;
+		v->meterPeak = 0;
+		v->meterSumSq = 0;
+#else
+		info->peak = (float)v->dMeterPeak;
+		info->rms = (samples > 0) ? (float)sqrt(v->dMeterSumSq / samples) : 0.0f;
+		v->dMeterPeak = 0.0;
+		v->dMeterSumSq = 0.0;
+#endif
+	}
 }
 
-static uint16_t pt2play_GetMasterVol(struct pt_state *state) {
-	return (uint16_t)state->masterVol;
+// buffer holds samples stereo frames in the format set with pt2play_SetOutputFormat(), int16 by default
+static void pt2play_FillAudioBuffer(struct pt_state *state, void *buffer, int32_t samples) {
+	const int32_t frameSize = outputFrameSize(state->outputFormat);
+	uint8_t *out = (uint8_t *)buffer;
+	int32_t a, b;
+
+	a = samples;
+	while(a > 0) {
+		if(state->samplesPerTickLeft == 0) {
+			if(!state->musicPaused) {
+				uint64_t t = PT2PLAY_TIMER();
+				tickReplayer(state);
+				state->tickTime += PT2PLAY_TIMER() - t;
+			}
+
+			state->samplesPerTickLeft = state->samplesPerTick;
+		}
+
+		b = a;
+		if(b > state->samplesPerTickLeft)
+			b = state->samplesPerTickLeft;
+
+		if(b > MIX_BUF_SAMPLES)
+			b = MIX_BUF_SAMPLES; // low BPMs at high rates have more samples per tick than the mixbuffer
+
+		uint64_t t = PT2PLAY_TIMER();
+		mixAudio(state, out, b);
+		state->mixTime += PT2PLAY_TIMER() - t;
+		out += b * frameSize;
+
+		a -= b;
+		state->samplesPerTickLeft -= b;
+	}
+
+	updateMeters(state, samples);
 }
 
-static uint32_t pt2play_GetMixerTicks(struct pt_state *state) {
-	if(state->audioRate < 1000)
-		return 0;
+/* OFFLINE RENDERING
+** Renders the song as fast as possible, without an audio device, until it loops (or maxSamples
+** stereo frames have been rendered). Start the song with pt2play_PlaySong() first.
+**
+** The loop is found by marking every row that gets played, one bit per row and order position.
+** A row that is played twice means that the song has looped. Rows that are repeated by an E6x
+** pattern loop are unmarked again when the loop jumps back, since that is not the song looping.
+*/
+typedef struct songLoopCheck_t {
+	uint64_t visited[128];
+	bool loopPending;
+	int8_t loopPos, loopRow;
+} songLoopCheck_t;
+
+static bool rowHasPatternLoop(struct pt_state *state) {
+	const uint32_t row = (state->OrderList[state->SongPosition] * 64) + (state->PatternPos >> 4);
+
+	for(int32_t i = 0; i < AMIGA_VOICES; i++) {
+		const patternChannel_t *patt = &state->Patterns[i];
+
+		if(patt->effect[row] == 0x0E && (patt->param[row] & 0xF0) == 0x60 && (patt->param[row] & 0x0F) != 0)
+			return true;
+	}
+
+	return false;
+}
 
-	return state->sampleCounter / (state->audioRate / 1000);
+// true if the next tickReplayer() starts a row, rows repeated by a pattern delay (EEx) don't count
+static inline bool tickStartsRow(struct pt_state *state) {
+	return state->Counter + 1 >= state->CurrSpeed && state->PattDelTime2 == 0;
 }
 
-static void pt2play_FillAudioBuffer(struct pt_state *state, int16_t *buffer, int32_t samples) {
+// call before every tickReplayer(), returns true if the tick would start a row that has already been played
+static bool songHasLooped(struct pt_state *state, songLoopCheck_t *lc) {
+	if(!state->SongPlaying)
+		return true;
+
+	if(!tickStartsRow(state))
+		return false; // this tick doesn't start a new row
+
+	const int8_t pos = state->SongPosition;
+	const int8_t row = (state->PatternPos >> 4) & 63;
+
+	if(lc->loopPending) {
+		lc->loopPending = false;
+
+		if(pos == lc->loopPos && row <= lc->loopRow) {
+			for(int8_t i = row; i <= lc->loopRow; i++)
+				lc->visited[pos] &= ~(UINT64_C(1) << i);
+		}
+	}
+
+	if(lc->visited[pos] & (UINT64_C(1) << row))
+		return true;
+
+	lc->visited[pos] |= UINT64_C(1) << row;
+
+	if(rowHasPatternLoop(state)) {
+		lc->loopPending = true;
+		lc->loopPos = pos;
+		lc->loopRow = row;
+	}
+
+	return false;
+}
+
+// same as pt2play_FillAudioBuffer(), but stops before the first tick of the song loop. Returns the amount of frames rendered
+static int32_t renderUntilLoop(struct pt_state *state, songLoopCheck_t *lc, void *buffer, int32_t samples) {
+	const int32_t frameSize = outputFrameSize(state->outputFormat);
+	uint8_t *out = (uint8_t *)buffer;
 	int32_t a, b;
 
 	a = samples;
 	while(a > 0) {
 		if(state->samplesPerTickLeft == 0) {
-			if(!state->musicPaused)
-				tickReplayer(state);
+			if(songHasLooped(state, lc))
+				break;
 
+			tickReplayer(state);
 			state->samplesPerTickLeft = state->samplesPerTick;
 		}
 
@@ -1792,12 +3450,390 @@ static void pt2play_FillAudioBuffer(struct pt_state *state, int16_t *buffer, int
 		if(b > state->samplesPerTickLeft)
 			b = state->samplesPerTickLeft;
 
-		mixAudio(state, buffer, b);
-		buffer += (uint32_t)b << 1;
+		if(b > MIX_BUF_SAMPLES)
+			b = MIX_BUF_SAMPLES;
+
+		mixAudio(state, out, b);
+		out += b * frameSize;
 
 		a -= b;
 		state->samplesPerTickLeft -= b;
 	}
 
-	state->sampleCounter += samples;
+	return samples - a;
+}
+
+// buffer holds maxSamples interleaved stereo frames in the output format. Returns the amount of frames rendered
+static int64_t pt2play_RenderToBuffer(struct pt_state *state, void *buffer, int64_t maxSamples) {
+	const int32_t frameSize = outputFrameSize(state->outputFormat);
+	songLoopCheck_t lc;
+	int64_t rendered = 0;
+
+	memset(&lc, 0, sizeof(lc));
+
+	while(rendered < maxSamples) {
+		int32_t b = (maxSamples - rendered > MIX_BUF_SAMPLES) ? MIX_BUF_SAMPLES : (int32_t)(maxSamples - rendered);
+
+		int32_t n = renderUntilLoop(state, &lc, (uint8_t *)buffer + (rendered * frameSize), b);
+		rendered += n;
+		if(n < b)
+			break;
+	}
+
+	return rendered;
+}
+
+static void writeLE32(uint8_t *p, uint32_t x) {
+	p[0] = (uint8_t)x;
+	p[1] = (uint8_t)(x >> 8);
+	p[2] = (uint8_t)(x >> 16);
+	p[3] = (uint8_t)(x >> 24);
+}
+
+// 16-bit stereo WAV, whatever the output format is. Returns the amount of frames rendered, or -1 on a file error
+static int64_t pt2play_RenderToWAV(struct pt_state *state, const char *fileName, int64_t maxSamples) {
+	static const uint8_t wavHeader[44] = {
+		'R','I','F','F', 0,0,0,0, 'W','A','V','E',
+		'f','m','t',' ', 16,0,0,0, 1,0, 2,0, 0,0,0,0, 0,0,0,0, 4,0, 16,0,
+		'd','a','t','a', 0,0,0,0
+	};
+	uint8_t header[44];
+	int16_t buffer[MIX_BUF_SAMPLES * 2];
+	songLoopCheck_t lc;
+	int64_t rendered = 0;
+	const int8_t outputFormat = state->outputFormat;
+
+	FILE *f = fopen(fileName, "wb");
+	if(f == NULL)
+		return -1;
+
+	state->outputFormat = OUTPUT_INT16;
+
+	memset(&lc, 0, sizeof(lc));
+	memcpy(header, wavHeader, sizeof(header));
+
+	bool ok = fwrite(header, 1, sizeof(header), f) == sizeof(header);
+
+	// the data chunk size is 32-bit
+	if(maxSamples > (INT32_MAX - (int64_t)sizeof(header)) / 4)
+		maxSamples = (INT32_MAX - (int64_t)sizeof(header)) / 4;
+
+	while(ok && rendered < maxSamples) {
+		int32_t b = (maxSamples - rendered > MIX_BUF_SAMPLES) ? MIX_BUF_SAMPLES : (int32_t)(maxSamples - rendered);
+
+		int32_t n = renderUntilLoop(state, &lc, buffer, b);
+		ok = fwrite(buffer, 4, n, f) == (size_t)n; // NOTE: little endian only, like the rest of the replayer
+
+		rendered += n;
+		if(n < b)
+			break;
+	}
+
+	if(ok) {
+		writeLE32(&header[4], (uint32_t)(36 + (rendered * 4)));
+		writeLE32(&header[24], (uint32_t)state->audioRate);
+		writeLE32(&header[28], (uint32_t)state->audioRate * 4);
+		writeLE32(&header[40], (uint32_t)(rendered * 4));
+
+		ok = fseek(f, 0, SEEK_SET) == 0 && fwrite(header, 1, sizeof(header), f) == sizeof(header);
+	}
+
+	state->outputFormat = outputFormat;
+
+	fclose(f);
+	return ok ? rendered : -1;
+}
+
+/* SEEKING
+** pt2play_Seek() needs the replayer state at the row to start from, and the only way to get it is
+** to play the song up to there. That is done with ticks only: the voices are moved on as far as
+** the samples of the tick would have moved them, without mixing anything, which takes well under a
+** millisecond for a whole song.
+**
+** The first seek runs the song once like that, until it loops, and keeps a checkpoint at the first
+** row played of every order position. A seek restores the checkpoint of the position and ticks on
+** from there to the row.
+**
+** Sample data that the replayer writes to (EFx, E8x) is not part of a checkpoint, it stays as the
+** song last left it. The filters and BLEPs start from rest, as after pt2play_PlaySong(), so the
+** first few milliseconds after a seek can differ slightly from playing through.
+*/
+typedef struct pt2Checkpoint_t {
+	ptChannel_t ChanTemp[AMIGA_VOICES];
+	paulaVoice_t paula[AMIGA_VOICES];
+	channelInfo_t channelInfo[AMIGA_VOICES];
+	uint64_t samplePos, tickPos;
+	int32_t samplesPerTick;
+	uint16_t PatternPos;
+	uint8_t rowSongPos, rowPattPos;
+	int8_t PBreakPosition, PattDelTime, PattDelTime2;
+	uint8_t SetBPMFlag, LowMask, Counter, CurrSpeed;
+	bool PBreakFlag, PosJumpAssert, LEDFilterOn;
+	bool valid;
+	uint8_t row; // the first row played at this position
+} pt2Checkpoint_t;
+
+// moves a voice on by numSamples, as far as mixing them would have
+static void skipVoice(paulaVoice_t *v, int32_t numSamples) {
+	int64_t whole;
+
+#ifdef USE_FIXEDPOINT
+	const uint64_t phase = v->phase + ((uint64_t)v->delta * numSamples);
+	whole = (int64_t)(phase >> 32);
+	v->phase = (uint32_t)phase;
+#else
+	const double dPhase = v->dPhase + (v->dDelta * numSamples);
+	whole = (int64_t)dPhase;
+	v->dPhase = dPhase - whole;
+#endif
+
+	// after the first wrap the voice loops newData, which can't change without a tick
+	while(whole > 0 && v->length > 0) {
+		if(v->data == v->newData && v->length == v->newLength) {
+			v->pos = (int32_t)((v->pos + whole) % v->length);
+			break;
+		}
+
+		const int64_t step = v->length - v->pos;
+		if(whole < step) {
+			v->pos += (int32_t)whole;
+			break;
+		}
+
+		whole -= step;
+		v->pos = 0;
+		v->length = v->newLength;
+		v->data = v->newData;
+	}
+}
+
+// a whole tick without mixing, the replayer has to be at the start of a tick (samplesPerTickLeft is 0)
+static void skipTick(struct pt_state *state) {
+	tickReplayer(state);
+
+	for(int32_t i = 0; i < AMIGA_VOICES; i++) {
+		if(state->paula[i].active)
+			skipVoice(&state->paula[i], state->samplesPerTick);
+	}
+
+	state->samplePos += state->samplesPerTick;
+}
+
+static void saveCheckpoint(struct pt_state *state, pt2Checkpoint_t *c) {
+	memcpy(c->ChanTemp, state->ChanTemp, sizeof(c->ChanTemp));
+	memcpy(c->paula, state->paula, sizeof(c->paula));
+	memcpy(c->channelInfo, state->channelInfo, sizeof(c->channelInfo));
+	c->samplePos = state->samplePos;
+	c->tickPos = state->tickPos;
+	c->samplesPerTick = state->samplesPerTick;
+	c->PatternPos = state->PatternPos;
+	c->rowSongPos = state->rowSongPos;
+	c->rowPattPos = state->rowPattPos;
+	c->PBreakPosition = state->PBreakPosition;
+	c->PattDelTime = state->PattDelTime;
+	c->PattDelTime2 = state->PattDelTime2;
+	c->SetBPMFlag = state->SetBPMFlag;
+	c->LowMask = state->LowMask;
+	c->Counter = state->Counter;
+	c->CurrSpeed = state->CurrSpeed;
+	c->PBreakFlag = state->PBreakFlag;
+	c->PosJumpAssert = state->PosJumpAssert;
+#ifdef LED_FILTER
+	c->LEDFilterOn = state->LEDFilterOn;
+#endif
+	c->row = (uint8_t)(state->PatternPos >> 4);
+	c->valid = true;
+}
+
+// the song continues from the checkpoint as if it had been played up to there
+static void loadCheckpoint(struct pt_state *state, int8_t songPosition, const pt2Checkpoint_t *c) {
+	rewindSong(state); // clears what isn't in the checkpoint: BLEPs, filters, dither
+
+	memcpy(state->ChanTemp, c->ChanTemp, sizeof(state->ChanTemp));
+	memcpy(state->paula, c->paula, sizeof(state->paula));
+	memcpy(state->channelInfo, c->channelInfo, sizeof(state->channelInfo));
+	calculatePans(state, state->stereoSep); // may have changed since the checkpoint was made
+	state->samplePos = c->samplePos;
+	state->tickPos = c->tickPos;
+	state->samplesPerTick = c->samplesPerTick;
+	state->SongPosition = songPosition;
+	state->PatternPos = c->PatternPos;
+	state->rowSongPos = c->rowSongPos;
+	state->rowPattPos = c->rowPattPos;
+	state->PBreakPosition = c->PBreakPosition;
+	state->PattDelTime = c->PattDelTime;
+	state->PattDelTime2 = c->PattDelTime2;
+	state->SetBPMFlag = c->SetBPMFlag;
+	state->LowMask = c->LowMask;
+	state->Counter = c->Counter;
+	state->CurrSpeed = c->CurrSpeed;
+	state->PBreakFlag = c->PBreakFlag;
+	state->PosJumpAssert = c->PosJumpAssert;
+#ifdef LED_FILTER
+	state->LEDFilterOn = c->LEDFilterOn;
+#endif
+}
+
+// runs the song from the start until it loops, with ticks only, and keeps a checkpoint per order position
+static bool makeCheckpoints(struct pt_state *state) {
+	songLoopCheck_t lc;
+
+	state->checkpoints = (pt2Checkpoint_t *)calloc(128, sizeof(pt2Checkpoint_t));
+	if(state->checkpoints == NULL)
+		return false;
+
+	memset(&lc, 0, sizeof(lc));
+	rewindSong(state);
+
+	while(!songHasLooped(state, &lc)) {
+		pt2Checkpoint_t *c = &state->checkpoints[state->SongPosition];
+		if(tickStartsRow(state) && !c->valid)
+			saveCheckpoint(state, c);
+
+		skipTick(state);
+	}
+
+	return true;
+}
+
+/* Starts the song at a row of an order position, pt2play_FillAudioBuffer() plays it from its first
+** tick. Returns false if the song never plays that row, or if there is no song. The song is then
+** left at the first row played of the position, or at its start.
+*/
+static bool pt2play_Seek(struct pt_state *state, uint8_t songPosition, uint8_t row) {
+	if(state->PatternData == NULL || songPosition >= state->SongLength || row >= 64)
+		return false;
+
+	if(state->checkpoints == NULL && !makeCheckpoints(state))
+		return false;
+
+	const pt2Checkpoint_t *c = &state->checkpoints[songPosition];
+	if(!c->valid || c->row > row) {
+		rewindSong(state);
+		return false;
+	}
+
+	loadCheckpoint(state, (int8_t)songPosition, c);
+
+	// E6x loops and pattern breaks can go back and forth inside the position, but not leave it and come back
+	while(state->SongPlaying && state->SongPosition == songPosition) {
+		if(tickStartsRow(state) && (state->PatternPos >> 4) == row)
+			return true;
+
+		skipTick(state);
+	}
+
+	loadCheckpoint(state, (int8_t)songPosition, c);
+	return false;
+}
+
+/* SONG ANALYSIS
+** pt2play_Analyze() plays the song until it loops with ticks only, like the checkpoint scan of
+** pt2play_Seek() but without moving the voices either, since only the replayer state is needed.
+** A song of several minutes takes well under a millisecond. It gives the length of the song, for
+** showing track lengths, and a timeline of what happens on each channel, for visuals that need to
+** know what is coming.
+**
+** The song is rewound to its start afterwards. The replayer state is the one playback uses, so
+** analyze a song that is playing in a pt_state of its own.
+*/
+enum {
+	EVENT_NOTE = 1, // a note, retrigger (E9x) or delayed note (EDx) started
+	EVENT_EFFECT = 2 // the row has an effect on this channel
+};
+
+typedef struct pt2Event_t {
+	uint64_t samplePos; // when it is heard, the start of the tick, like channelInfo_t::triggerPos
+	uint16_t period; // as set in Paula after the tick
+	uint8_t songPosition, row, tick;
+	uint8_t channel;
+	uint8_t flags; // EVENT_*
+	uint8_t sample; // 1..31, the last note of the channel if EVENT_NOTE isn't set
+	uint8_t volume; // 0..64, as set in Paula after the tick
+	uint8_t effect, param; // 0 if EVENT_EFFECT isn't set
+} pt2Event_t;
+
+typedef struct pt2Analysis_t {
+	uint64_t duration; // stereo frames until the song loops
+	int32_t audioRate;
+	uint32_t numEvents; // in the whole song, only the first maxEvents of them are stored
+	int8_t loopPosition, loopRow; // where the song goes on after it loops, -1 if maxSamples came first
+} pt2Analysis_t;
+
+/* Runs the song started with pt2play_PlaySong() until it loops, or for maxSamples stereo frames,
+** and stores up to maxEvents events in order of samplePos. Call with maxEvents 0 to count them.
+** Returns false if there is no song.
+*/
+static bool pt2play_Analyze(struct pt_state *state, pt2Event_t *events, uint32_t maxEvents, int64_t maxSamples, pt2Analysis_t *analysis) {
+	songLoopCheck_t lc;
+	uint32_t triggerCount[AMIGA_VOICES];
+
+	memset(analysis, 0, sizeof(*analysis));
+	analysis->audioRate = state->audioRate;
+	analysis->loopPosition = -1;
+	analysis->loopRow = -1;
+
+	if(state->PatternData == NULL)
+		return false;
+
+	memset(&lc, 0, sizeof(lc));
+	rewindSong(state);
+
+	for(int32_t i = 0; i < AMIGA_VOICES; i++)
+		triggerCount[i] = state->channelInfo[i].triggerCount;
+
+	while(state->samplePos < (uint64_t)maxSamples) {
+		if(songHasLooped(state, &lc)) {
+			analysis->loopPosition = state->SongPosition;
+			analysis->loopRow = (int8_t)(state->PatternPos >> 4);
+			break;
+		}
+
+		const bool rowStarted = tickStartsRow(state);
+		tickReplayer(state);
+
+		for(int32_t i = 0; i < AMIGA_VOICES; i++) {
+			const channelInfo_t *info = &state->channelInfo[i];
+			uint8_t flags = 0, effect = 0, param = 0;
+
+			if(info->triggerCount != triggerCount[i]) {
+				triggerCount[i] = info->triggerCount;
+				flags |= EVENT_NOTE;
+			}
+
+			if(rowStarted) {
+				effect = state->Patterns[i].effect[state->PattRow];
+				param = state->Patterns[i].param[state->PattRow];
+				if(effect != 0 || param != 0)
+					flags |= EVENT_EFFECT;
+			}
+
+			if(flags == 0)
+				continue;
+
+			if(analysis->numEvents < maxEvents) {
+				pt2Event_t *e = &events[analysis->numEvents];
+
+				e->samplePos = state->samplePos;
+				e->period = info->period;
+				e->songPosition = state->rowSongPos;
+				e->row = state->rowPattPos;
+				e->tick = state->Counter;
+				e->channel = (uint8_t)i;
+				e->flags = flags;
+				e->sample = info->sample;
+				e->volume = info->volume;
+				e->effect = effect;
+				e->param = param;
+			}
+
+			analysis->numEvents++;
+		}
+
+		state->samplePos += state->samplesPerTick;
+	}
+
+	analysis->duration = state->samplePos;
+	rewindSong(state);
+	return true;
 }
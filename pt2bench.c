@@ -0,0 +1,213 @@
+/*
+ * pt2bench - offline replayer benchmark
+ *
+ * Renders a module until it loops, several times, with no audio device, and reports how much
+ * faster than realtime the replayer is, and how the time is split between tickReplayer() and
+ * mixAudio(). Then the mixer cost of every interpolation tier the build has, and the speed of
+ * pt2play_Analyze(). Exits with 1 if the speed with the default tier is below the optional minimum,
+ * so it can be used as a regression gate.
+ *
+ * usage: pt2bench [module.mod] [rate] [runs] [min x realtime] [out.wav]
+ *
+ * gcc -O2 -o pt2bench pt2bench.c -lm
+ */
+
+#include <time.h>
+
+#include "protracker2.c"
+
+#define BENCH_MAX_SECONDS (30 * 60)
+
+static uint64_t nanoTime(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000) + ts.tv_nsec;
+}
+
+static uint8_t *loadFile(const char *fileName) {
+	FILE *f = fopen(fileName, "rb");
+	if(f == NULL)
+		return NULL;
+
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+
+	uint8_t *data = malloc(size);
+	if(data != NULL && fread(data, 1, size, f) != (size_t)size) {
+		free(data);
+		data = NULL;
+	}
+
+	fclose(f);
+	return data;
+}
+
+static const char *interpolationNames[INTERPOLATION_COUNT] = { "nearest", "linear", "blep", "sinc" };
+
+typedef struct benchResult_t {
+	uint64_t tickTime, mixTime;
+	int64_t frames, voiceFrames;
+} benchResult_t;
+
+// renderUntilLoop() with the tick and the mix timed separately
+static void benchRun(struct pt_state *state, int16_t *buffer, int64_t maxSamples, benchResult_t *r) {
+	songLoopCheck_t lc;
+	uint64_t t;
+
+	memset(&lc, 0, sizeof(lc));
+
+	while(r->frames < maxSamples) {
+		if(state->samplesPerTickLeft == 0) {
+			if(songHasLooped(state, &lc))
+				break;
+
+			t = nanoTime();
+			tickReplayer(state);
+			r->tickTime += nanoTime() - t;
+
+			state->samplesPerTickLeft = state->samplesPerTick;
+		}
+
+		int32_t b = state->samplesPerTickLeft;
+		if(b > MIX_BUF_SAMPLES)
+			b = MIX_BUF_SAMPLES;
+
+		if(b > maxSamples - r->frames)
+			b = (int32_t)(maxSamples - r->frames);
+
+		for(int32_t i = 0; i < AMIGA_VOICES; i++) {
+			if(state->paula[i].active)
+				r->voiceFrames += b;
+		}
+
+		t = nanoTime();
+		mixAudio(state, buffer, b);
+		r->mixTime += nanoTime() - t;
+
+		r->frames += b;
+		state->samplesPerTickLeft -= b;
+	}
+}
+
+// the fastest of runs renders, the others are mostly scheduler noise. False if the tier isn't in this build
+static bool benchTier(struct pt_state *state, const uint8_t *moduleData, uint32_t rate, int32_t runs, int8_t interpolation, int16_t *buffer, benchResult_t *best) {
+	memset(best, 0, sizeof(*best));
+
+	for(int32_t i = 0; i < runs; i++) {
+		benchResult_t r;
+		memset(&r, 0, sizeof(r));
+
+		pt2play_PlaySong(state, moduleData, CIA_TEMPO_MODE, rate);
+		if(!pt2play_SetInterpolation(state, interpolation))
+			return false;
+
+		benchRun(state, buffer, (int64_t)BENCH_MAX_SECONDS * state->audioRate, &r);
+
+		if(i == 0 || (r.tickTime + r.mixTime) < (best->tickTime + best->mixTime))
+			*best = r;
+	}
+
+	return true;
+}
+
+int main(int argc, char **argv) {
+	const char *fileName = (argc > 1) ? argv[1] : "music/zeus.mod";
+	const uint32_t rate = (argc > 2) ? (uint32_t)atoi(argv[2]) : 48000;
+	const int32_t runs = (argc > 3) ? atoi(argv[3]) : 5;
+	const double minSpeed = (argc > 4) ? atof(argv[4]) : 0.0;
+	const char *wavName = (argc > 5) ? argv[5] : NULL;
+
+	const uint8_t *moduleData = loadFile(fileName);
+	if(moduleData == NULL) {
+		fprintf(stderr, "pt2bench: can't load %s\n", fileName);
+		return 2;
+	}
+
+	struct pt_state *state = calloc(1, sizeof(struct pt_state));
+	int16_t *buffer = malloc(MIX_BUF_SAMPLES * sizeof(int16_t) * 2);
+	if(state == NULL || buffer == NULL) {
+		fprintf(stderr, "pt2bench: out of memory\n");
+		return 2;
+	}
+
+	pt2play_initPlayer(rate);
+
+	if(!pt2play_PlaySong(state, moduleData, CIA_TEMPO_MODE, rate)) {
+		fprintf(stderr, "pt2bench: %s is not a supported module\n", fileName);
+		return 2;
+	}
+
+	benchResult_t best;
+	benchTier(state, moduleData, rate, runs, DEFAULT_INTERPOLATION, buffer, &best);
+
+	const double songSeconds = (double)best.frames / state->audioRate;
+	const double totalSeconds = (best.tickTime + best.mixTime) * 1e-9;
+	const double speed = songSeconds / totalSeconds;
+
+	printf("module:        %s (%.2f seconds @ %dHz)\n", fileName, songSeconds, state->audioRate);
+	printf("speed:         %.0f samples/s (%.1fx realtime)\n", best.frames / totalSeconds, speed);
+	printf("mix:           %.2f ns per sample per voice\n", (best.voiceFrames > 0) ? (double)best.mixTime / best.voiceFrames : 0.0);
+	printf("tickReplayer:  %.3f ms (%.1f%%)\n", best.tickTime * 1e-6, (best.tickTime * 100.0) / (best.tickTime + best.mixTime));
+	printf("mixAudio:      %.3f ms (%.1f%%)\n", best.mixTime * 1e-6, (best.mixTime * 100.0) / (best.tickTime + best.mixTime));
+
+	printf("\ninterpolation  ns/sample/voice  x realtime\n");
+	for(int8_t i = 0; i < INTERPOLATION_COUNT; i++) {
+		benchResult_t r;
+
+		if(!benchTier(state, moduleData, rate, runs, i, buffer, &r)) {
+			printf("%-14s %15s\n", interpolationNames[i], "-");
+			continue;
+		}
+
+		printf("%-14s %15.2f %11.1f%s\n", interpolationNames[i], (r.voiceFrames > 0) ? (double)r.mixTime / r.voiceFrames : 0.0,
+			((double)r.frames / state->audioRate) / ((r.tickTime + r.mixTime) * 1e-9), (i == DEFAULT_INTERPOLATION) ? " (default)" : "");
+	}
+
+	// count the events first, then the fastest of runs analyses with all of them stored
+	pt2Analysis_t analysis;
+	pt2play_Analyze(state, NULL, 0, (int64_t)BENCH_MAX_SECONDS * state->audioRate, &analysis);
+
+	pt2Event_t *events = malloc((analysis.numEvents + 1) * sizeof(pt2Event_t));
+	if(events == NULL) {
+		fprintf(stderr, "pt2bench: out of memory for %u events, analysis skipped\n", analysis.numEvents);
+	} else {
+		uint64_t analysisTime = 0;
+
+		for(int32_t i = 0; i < runs; i++) {
+			uint64_t t = nanoTime();
+			pt2play_Analyze(state, events, analysis.numEvents, (int64_t)BENCH_MAX_SECONDS * state->audioRate, &analysis);
+			t = nanoTime() - t;
+
+			if(i == 0 || t < analysisTime)
+				analysisTime = t;
+		}
+
+		printf("\nanalysis:      %.3f ms (%.0fx realtime), %.2f seconds, %u events, loops to %d/%d\n", analysisTime * 1e-6,
+			((double)analysis.duration / analysis.audioRate) / (analysisTime * 1e-9), (double)analysis.duration / analysis.audioRate,
+			analysis.numEvents, analysis.loopPosition, analysis.loopRow);
+
+		free(events);
+	}
+
+	if(wavName != NULL) {
+		pt2play_PlaySong(state, moduleData, CIA_TEMPO_MODE, rate);
+		pt2play_SetInterpolation(state, DEFAULT_INTERPOLATION); // the tier table left the last tier set
+		if(pt2play_RenderToWAV(state, wavName, (int64_t)BENCH_MAX_SECONDS * state->audioRate) < 0)
+			fprintf(stderr, "pt2bench: can't write %s\n", wavName);
+	}
+
+	pt2play_Close(state);
+
+	free(buffer);
+	free(state);
+	free((void *)moduleData);
+
+	if(minSpeed > 0.0 && speed < minSpeed) {
+		printf("FAIL: below %.1fx realtime\n", minSpeed);
+		return 1;
+	}
+
+	return 0;
+}
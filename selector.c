@@ -4,6 +4,22 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdatomic.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BLIT_SIMD_X86
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#endif
 
 // Framework includes
 #include <loader.h>
@@ -17,22 +33,653 @@
 #define UTILS_IMPLEMENTATION
 #include "utils.h"
 
+// Nanoseconds from an arbitrary start, for the timings
+static uint64_t timer_now(void) {
+#ifdef _WIN32
+	static LARGE_INTEGER frequency;
+	LARGE_INTEGER counter;
+	if(!frequency.QuadPart) {
+		QueryPerformanceFrequency(&frequency);
+	}
+	QueryPerformanceCounter(&counter);
+	return (uint64_t)((double)counter.QuadPart * 1e9 / (double)frequency.QuadPart);
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+#define PT2PLAY_TIMER() timer_now()
 #include "protracker2.c"
 
+// The music is played straight from this file when it's there, so it can be changed without a rebuild. zeus.mod is the fallback.
+#ifndef SELECTOR_MUSIC_FILE
+#define SELECTOR_MUSIC_FILE "remakes/selector_mks_first.mod"
+#endif
+
 struct selector_info selector_information;
 
+#define SEARCH_MAX_LENGTH 32
+
+// Lowercased display names and, for every character, the remakes that have it somewhere in the name
+struct search_index {
+	char *names;					// 0-terminated names one after the other
+	uint32_t *name_offsets;			// per remake
+	uint32_t *char_entries;			// char_entries[char_start[c] .. char_start[c + 1]] has c in the name, in remake order
+	uint32_t char_start[257];
+};
+
+/*
+ * Every stage of a frame, and every audio_callback() split in replayer ticks and mixing, is timed
+ * into a ring of the last TIMING_SAMPLES runs, a frame that skips a stage adds nothing to its ring.
+ * F1 shows the p50/p99/max of each below the list, building with SELECTOR_TIMING_REPORT prints them
+ * when the selector exits.
+ */
+#define TIMING_SAMPLES 512
+
+enum {
+	TIMING_FRAME,					// all of mainloop_callback()
+	TIMING_CLEAR,					// clearing the background
+	TIMING_COPY,					// background to frame buffer
+	TIMING_COPPER,
+	TIMING_SELECTION_BAR,
+	TIMING_TEXT,
+	TIMING_STARS,					// restoring and drawing
+	TIMING_INTERVAL,				// from the start of one frame to the next, 20ms unless frames are dropped
+	TIMING_AUDIO,					// all of audio_callback()
+	TIMING_AUDIO_TICK,
+	TIMING_AUDIO_MIX,
+	TIMING_DELAY,					// from the last mixed sample to the one being heard, once per frame
+	TIMING_COUNT
+};
+
+static const char *timing_names[TIMING_COUNT] = { "frame", "clear", "copy", "copper", "bar", "text", "stars", "period", "audio", " tick", " mix", "delay" };
+
+struct timing_ring {
+	uint32_t ns[TIMING_SAMPLES];
+	uint32_t count;
+	uint32_t next;
+};
+
+/*
+ * Threads
+ *
+ * audio_callback() runs on the audio thread and is the only one that touches zeus. The rest of the
+ * state belongs to the main thread: setup(), key_callback(), mainloop_callback() and cleanup().
+ * The main thread controls the player through the command queue, and the audio thread hands back
+ * what the player is doing through the snapshot and its timings through the timing queue. Neither
+ * side ever waits for the other.
+ */
+#define AUDIO_QUEUE_SIZE 64
+
+/*
+ * Commands only change settings of the playing song. A song switch would have to hand over a
+ * pt_state prepared on the main thread, pt2play_PlaySong() allocates and frees.
+ */
+enum {
+	AUDIO_PAUSE,					// value is 1 to pause, 0 to continue
+	AUDIO_MASTER_VOLUME,			// value is 0..256
+	AUDIO_STEREO_SEPARATION,		// value is 0..100
+};
+
+struct audio_command {
+	uint32_t type;
+	uint32_t value;
+};
+
+// One audio_callback(), in nanoseconds
+struct audio_timing {
+	uint64_t total;
+	uint64_t tick;
+	uint64_t mix;
+};
+
+// Ring of AUDIO_QUEUE_SIZE items for one producer and one consumer, the items are kept by the user. Only the producer writes tail and only the consumer writes head.
+struct spsc_queue {
+	_Atomic uint32_t head;
+	uint8_t pad[60];				// head and tail on their own cache lines
+	_Atomic uint32_t tail;
+};
+
+struct audio_snapshot {
+	channelInfo_t channels[AMIGA_VOICES];	// triggers, sample, volume, period and levels, see protracker2.c
+	pt2Clock_t clock;				// at the end of the callback, triggers are in clock.samplePos time
+	uint64_t callback_time;			// timer_now() when the callback was done
+	uint32_t callback_frames;
+};
+
+/*
+ * Triple buffer, the audio thread fills buffers[back] and swaps it with latest, the main thread
+ * swaps buffers[front] with latest when there is a fresh one. The reader always has a complete
+ * snapshot and the writer never waits for it.
+ */
+#define SNAPSHOT_FRESH 4
+struct snapshot_exchange {
+	struct audio_snapshot buffers[3];
+	_Atomic uint32_t latest;		// buffer index, SNAPSHOT_FRESH is set until the main thread takes it
+	uint32_t back;					// audio thread
+	uint32_t front;					// main thread
+};
+
+/*
+ * The starfield scrolls left behind the list. Every star belongs to a layer, which gives its speed
+ * and color, and the stars are spread over the STAR_ROWS rows in row order so they are drawn going
+ * forward through memory. The defaults, one star per row with the layer going 0-3 down the rows,
+ * are the original look.
+ */
+#define STAR_FIRST_ROW 79
+#define STAR_ROWS (8*9)
+#define SELECTION_BAR_FIRST_ROW 80
+
+#ifndef STARFIELD_STARS
+#define STARFIELD_STARS 72
+#endif
+
+struct star_layer {
+	int32_t speed;					// pixels per frame
+	uint32_t color;
+};
+
+static const struct star_layer star_layers[] = {
+	{ 1, 0x444444ff },
+	{ 2, 0x777777ff },
+	{ 3, 0xaaaaaaff },
+	{ 4, 0xffffffff },
+};
+#define STAR_LAYERS (sizeof(star_layers) / sizeof(star_layers[0]))
+
+// One array per field, so the scroll is a straight vector pass over x and speed
+struct starfield {
+	uint32_t count;
+	int32_t *x;
+	int32_t *speed;
+	uint32_t *color;
+	uint32_t *row_offset;			// row * buffer_width, from STAR_FIRST_ROW
+	uint8_t *row;
+	uint32_t *drawn_offset;			// where render_stars() drew each star, so it can be restored from the background
+};
+
+/*
+ * A remake name rasterized with the font. Only the names around the visible lines are kept: a line
+ * of the list uses slot line % TEXT_STRIP_CACHE, so the lines on screen never share a slot and a
+ * strip is made again when its slot is taken by another remake. The memory doesn't grow with the
+ * number of remakes.
+ */
+#define TEXT_STRIP_CACHE 32			// the LIST_ROWS + 1 lines on screen and a margin for scrolling
+
+struct text_strip {
+	uint32_t *pixels;				// 8 rows of width pixels
+	uint8_t *mask;					// 1 where pixels has a glyph pixel
+	uint32_t width;
+	uint32_t entry;					// remake + 1 the strip was made for, 0 for an empty slot
+	size_t size;					// bytes allocated at pixels, kept when the slot is reused
+};
+
 struct selector_state {
 	struct loader_shared_state *shared;
 	struct pt_state zeus;
+	const uint8_t *music_file;		// mapped SELECTOR_MUSIC_FILE, 0 if zeus_data is played
+	size_t music_file_size;
 	struct loader_info *remakes;
-	uint32_t star_x[120];
+	struct text_strip text_strips[TEXT_STRIP_CACHE];
+	struct starfield stars;
+	uint32_t *background;			// the frame without the stars: copper lines, selection bar and text
+	uint8_t *text_mask;				// 1 where the background has a text pixel, stars are drawn behind the text
+	uint32_t *letter_entries;		// entries grouped by the first character of their name, built the first time a letter is pressed
+	uint32_t letter_start[37];		// letter_entries[letter_start[i] .. letter_start[i + 1]] start with 0-9, A-Z
+	struct search_index search;
+	bool searching;					// keys go to the search instead of jumping to a letter
+	char query[SEARCH_MAX_LENGTH + 1];
+	uint32_t query_length;
+	uint32_t *matches[SEARCH_MAX_LENGTH + 1];	// remakes matching the first n characters of the query, 0 for all of them
+	uint32_t match_count[SEARCH_MAX_LENGTH + 1];
+	uint32_t *list_entries;			// the remakes in the list, 0 when the list is all of them
+	uint32_t list_count;
+	bool list_changed;				// the list was filtered since the last frame
+	struct spsc_queue command_queue;	// main thread -> audio thread
+	struct audio_command commands[AUDIO_QUEUE_SIZE];
+	struct spsc_queue timing_queue;	// audio thread -> main thread
+	struct audio_timing audio_timings[AUDIO_QUEUE_SIZE];
+	struct snapshot_exchange snapshot;	// audio thread -> main thread
+	bool music_paused;
+	double playing_position;		// last playing_sample_position(), it only moves forward within a song
+	struct timing_ring timings[TIMING_COUNT];
+	uint64_t stage_time[TIMING_COUNT];	// the stages of the current frame, they can run several times
+	uint32_t stages_run;			// bit per stage that ran in the current frame, the others aren't pushed
+	uint64_t frame_start;
+	bool show_timings;
+	bool timings_changed;			// the overlay was switched on or off
+	uint32_t frame_count;
+	uint32_t drawn_top;				// what the background and the frame buffer show
+	uint32_t drawn_bar_y;
+	bool full_redraw;				// the frame buffer holds nothing of ours yet
 	int32_t old_mouse_x;
 	int32_t old_mouse_y;
 	struct rng_state rand_state;
 	uint32_t remake_count;
-	int32_t current_y;
+	int32_t current_y;				// pixel position of the selection bar in the list, LIST_ROW_HEIGHT per entry
 };
 
+static const uint8_t *map_file(const char *path, size_t *size) {
+	const uint8_t *data = 0;
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+	if(file == INVALID_HANDLE_VALUE) {
+		return 0;
+	}
+
+	LARGE_INTEGER file_size;
+	if(GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0) {
+		HANDLE mapping = CreateFileMappingA(file, 0, PAGE_READONLY, 0, 0, 0);
+		if(mapping) {
+			data = (const uint8_t *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+			CloseHandle(mapping);		// the view keeps the mapping alive
+			*size = (size_t)file_size.QuadPart;
+		}
+	}
+	CloseHandle(file);
+#else
+	int fd = open(path, O_RDONLY);
+	if(fd < 0) {
+		return 0;
+	}
+
+	struct stat st;
+	if(fstat(fd, &st) == 0 && st.st_size > 0) {
+		void *mapping = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(mapping != MAP_FAILED) {
+			data = (const uint8_t *)mapping;
+			*size = st.st_size;
+		}
+	}
+	close(fd);		// the mapping stays valid
+#endif
+	return data;
+}
+
+static void unmap_file(const uint8_t *data, size_t size) {
+#ifdef _WIN32
+	(void) size;
+	UnmapViewOfFile(data);
+#else
+	munmap((void *)data, size);
+#endif
+}
+
+/*
+ * Blitters, picked for the CPU in setup().
+ *
+ * blit_glyph_row: expands 8 palette indices to ARGB, index 0 is transparent and leaves dest alone.
+ * blit_masked_row: copies the pixels of src where src_mask is set, and sets dest_mask there.
+ * scroll_stars: moves count stars left by their speed, wrapping around at width.
+ * fill_span: sets count pixels to color.
+ */
+static void blit_glyph_row_scalar(uint32_t *dest, const uint8_t *indices, const uint32_t *palette) {
+	for(uint32_t x = 0; x < 8; ++x) {
+		dest[x] = indices[x] ? palette[indices[x]] : dest[x];
+	}
+}
+
+static void blit_masked_row_scalar(uint32_t *dest, uint8_t *dest_mask, const uint32_t *src, const uint8_t *src_mask, uint32_t width) {
+	for(uint32_t x = 0; x < width; ++x) {
+		if(src_mask[x]) {
+			dest[x] = src[x];
+			dest_mask[x] = 1;
+		}
+	}
+}
+
+static void scroll_stars_scalar(int32_t *x, const int32_t *speed, uint32_t count, int32_t width) {
+	for(uint32_t i = 0; i < count; ++i) {
+		x[i] -= speed[i];
+		x[i] += (x[i] < 0) ? width : 0;
+	}
+}
+
+static void fill_span_scalar(uint32_t *dest, uint32_t color, uint32_t count) {
+	for(uint32_t i = 0; i < count; ++i) {
+		dest[i] = color;
+	}
+}
+
+#ifdef BLIT_SIMD_X86
+__attribute__((target("sse2")))
+static void fill_span_sse2(uint32_t *dest, uint32_t color, uint32_t count) {
+	__m128i c = _mm_set1_epi32((int32_t)color);
+	uint32_t i = 0;
+	for(; i + 4 <= count; i += 4) {
+		_mm_storeu_si128((__m128i *)&dest[i], c);
+	}
+	fill_span_scalar(dest + i, color, count - i);
+}
+
+__attribute__((target("avx2")))
+static void fill_span_avx2(uint32_t *dest, uint32_t color, uint32_t count) {
+	__m256i c = _mm256_set1_epi32((int32_t)color);
+	uint32_t i = 0;
+	for(; i + 16 <= count; i += 16) {
+		_mm256_storeu_si256((__m256i *)&dest[i], c);
+		_mm256_storeu_si256((__m256i *)&dest[i + 8], c);
+	}
+	fill_span_sse2(dest + i, color, count - i);
+}
+
+__attribute__((target("sse2")))
+static void scroll_stars_sse2(int32_t *x, const int32_t *speed, uint32_t count, int32_t width) {
+	__m128i w = _mm_set1_epi32(width);
+	uint32_t i = 0;
+	for(; i + 4 <= count; i += 4) {
+		__m128i v = _mm_sub_epi32(_mm_loadu_si128((const __m128i *)&x[i]), _mm_loadu_si128((const __m128i *)&speed[i]));
+		v = _mm_add_epi32(v, _mm_and_si128(_mm_srai_epi32(v, 31), w));
+		_mm_storeu_si128((__m128i *)&x[i], v);
+	}
+	scroll_stars_scalar(x + i, speed + i, count - i, width);
+}
+
+__attribute__((target("avx2")))
+static void scroll_stars_avx2(int32_t *x, const int32_t *speed, uint32_t count, int32_t width) {
+	__m256i w = _mm256_set1_epi32(width);
+	uint32_t i = 0;
+	for(; i + 8 <= count; i += 8) {
+		__m256i v = _mm256_sub_epi32(_mm256_loadu_si256((const __m256i *)&x[i]), _mm256_loadu_si256((const __m256i *)&speed[i]));
+		v = _mm256_add_epi32(v, _mm256_and_si256(_mm256_srai_epi32(v, 31), w));
+		_mm256_storeu_si256((__m256i *)&x[i], v);
+	}
+	scroll_stars_scalar(x + i, speed + i, count - i, width);
+}
+
+__attribute__((target("sse4.1")))
+static void blit_glyph_row_sse41(uint32_t *dest, const uint8_t *indices, const uint32_t *palette) {
+	__m128i idx = _mm_loadl_epi64((const __m128i *)indices);
+	__m128i transparent_lo = _mm_cmpeq_epi32(_mm_cvtepu8_epi32(idx), _mm_setzero_si128());
+	__m128i transparent_hi = _mm_cmpeq_epi32(_mm_cvtepu8_epi32(_mm_srli_si128(idx, 4)), _mm_setzero_si128());
+	__m128i color_lo = _mm_set_epi32(palette[indices[3]], palette[indices[2]], palette[indices[1]], palette[indices[0]]);
+	__m128i color_hi = _mm_set_epi32(palette[indices[7]], palette[indices[6]], palette[indices[5]], palette[indices[4]]);
+
+	_mm_storeu_si128((__m128i *)&dest[0], _mm_blendv_epi8(color_lo, _mm_loadu_si128((const __m128i *)&dest[0]), transparent_lo));
+	_mm_storeu_si128((__m128i *)&dest[4], _mm_blendv_epi8(color_hi, _mm_loadu_si128((const __m128i *)&dest[4]), transparent_hi));
+}
+
+__attribute__((target("sse4.1")))
+static void blit_masked_row_sse41(uint32_t *dest, uint8_t *dest_mask, const uint32_t *src, const uint8_t *src_mask, uint32_t width) {
+	uint32_t x = 0;
+	for(; x + 4 <= width; x += 4) {
+		uint32_t mask4;
+		memcpy(&mask4, &src_mask[x], 4);
+		if(!mask4) {
+			continue;
+		}
+		__m128i transparent = _mm_cmpeq_epi32(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(mask4)), _mm_setzero_si128());
+		__m128i d = _mm_loadu_si128((const __m128i *)&dest[x]);
+		_mm_storeu_si128((__m128i *)&dest[x], _mm_blendv_epi8(_mm_loadu_si128((const __m128i *)&src[x]), d, transparent));
+
+		uint32_t dest_mask4;
+		memcpy(&dest_mask4, &dest_mask[x], 4);
+		dest_mask4 |= mask4;
+		memcpy(&dest_mask[x], &dest_mask4, 4);
+	}
+	blit_masked_row_scalar(dest + x, dest_mask + x, src + x, src_mask + x, width - x);
+}
+
+__attribute__((target("avx2")))
+static void blit_glyph_row_avx2(uint32_t *dest, const uint8_t *indices, const uint32_t *palette) {
+	__m256i idx = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)indices));
+	__m256i color = _mm256_i32gather_epi32((const int *)palette, idx, 4);
+	__m256i transparent = _mm256_cmpeq_epi32(idx, _mm256_setzero_si256());
+
+	_mm256_storeu_si256((__m256i *)dest, _mm256_blendv_epi8(color, _mm256_loadu_si256((const __m256i *)dest), transparent));
+}
+
+__attribute__((target("avx2")))
+static void blit_masked_row_avx2(uint32_t *dest, uint8_t *dest_mask, const uint32_t *src, const uint8_t *src_mask, uint32_t width) {
+	uint32_t x = 0;
+	for(; x + 8 <= width; x += 8) {
+		uint64_t mask8;
+		memcpy(&mask8, &src_mask[x], 8);
+		if(!mask8) {
+			continue;
+		}
+		__m256i transparent = _mm256_cmpeq_epi32(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)&src_mask[x])), _mm256_setzero_si256());
+		__m256i d = _mm256_loadu_si256((const __m256i *)&dest[x]);
+		_mm256_storeu_si256((__m256i *)&dest[x], _mm256_blendv_epi8(_mm256_loadu_si256((const __m256i *)&src[x]), d, transparent));
+
+		uint64_t dest_mask8;
+		memcpy(&dest_mask8, &dest_mask[x], 8);
+		dest_mask8 |= mask8;
+		memcpy(&dest_mask[x], &dest_mask8, 8);
+	}
+	blit_masked_row_scalar(dest + x, dest_mask + x, src + x, src_mask + x, width - x);
+}
+#endif
+
+static void (*blit_glyph_row)(uint32_t *dest, const uint8_t *indices, const uint32_t *palette) = blit_glyph_row_scalar;
+static void (*blit_masked_row)(uint32_t *dest, uint8_t *dest_mask, const uint32_t *src, const uint8_t *src_mask, uint32_t width) = blit_masked_row_scalar;
+static void (*scroll_stars)(int32_t *x, const int32_t *speed, uint32_t count, int32_t width) = scroll_stars_scalar;
+static void (*fill_span)(uint32_t *dest, uint32_t color, uint32_t count) = fill_span_scalar;
+
+static void select_blitters(void) {
+#ifdef BLIT_SIMD_X86
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx2")) {
+		blit_glyph_row = blit_glyph_row_avx2;
+		blit_masked_row = blit_masked_row_avx2;
+		scroll_stars = scroll_stars_avx2;
+		fill_span = fill_span_avx2;
+	} else if(__builtin_cpu_supports("sse4.1")) {
+		blit_glyph_row = blit_glyph_row_sse41;
+		blit_masked_row = blit_masked_row_sse41;
+		scroll_stars = scroll_stars_sse2;
+		fill_span = fill_span_sse2;
+	} else if(__builtin_cpu_supports("sse2")) {
+		scroll_stars = scroll_stars_sse2;
+		fill_span = fill_span_sse2;
+	}
+#endif
+}
+
+static bool spsc_push(struct spsc_queue *queue, void *items, size_t item_size, const void *item) {
+	uint32_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+	uint32_t head = atomic_load_explicit(&queue->head, memory_order_acquire);
+
+	if(tail - head == AUDIO_QUEUE_SIZE) {
+		return false;
+	}
+	memcpy((uint8_t *)items + (tail % AUDIO_QUEUE_SIZE) * item_size, item, item_size);
+	atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+	return true;
+}
+
+static bool spsc_pop(struct spsc_queue *queue, const void *items, size_t item_size, void *item) {
+	uint32_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+	uint32_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+
+	if(head == tail) {
+		return false;
+	}
+	memcpy(item, (const uint8_t *)items + (head % AUDIO_QUEUE_SIZE) * item_size, item_size);
+	atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+	return true;
+}
+
+// Main thread, the command is dropped if the audio thread is AUDIO_QUEUE_SIZE commands behind
+static bool send_audio_command(struct selector_state *state, uint32_t type, uint32_t value) {
+	struct audio_command command = { .type = type, .value = value };
+	return spsc_push(&state->command_queue, state->commands, sizeof(command), &command);
+}
+
+// Audio thread
+static void run_audio_command(struct selector_state *state, struct audio_command *command) {
+	switch(command->type) {
+		case AUDIO_PAUSE:             pt2play_PauseSong(&state->zeus, command->value != 0);         break;
+		case AUDIO_MASTER_VOLUME:     pt2play_SetMasterVol(&state->zeus, (uint16_t)command->value); break;
+		case AUDIO_STEREO_SEPARATION: pt2play_SetStereoSep(&state->zeus, (uint8_t)command->value);  break;
+	}
+}
+
+// Audio thread
+static void publish_snapshot(struct selector_state *state, uint32_t frames) {
+	struct snapshot_exchange *exchange = &state->snapshot;
+	struct audio_snapshot *snapshot = &exchange->buffers[exchange->back];
+
+	memcpy(snapshot->channels, state->zeus.channelInfo, sizeof(snapshot->channels));
+	pt2play_GetClock(&state->zeus, &snapshot->clock);
+	snapshot->callback_time = timer_now();
+	snapshot->callback_frames = frames;
+
+	exchange->back = atomic_exchange_explicit(&exchange->latest, exchange->back | SNAPSHOT_FRESH, memory_order_acq_rel) & ~SNAPSHOT_FRESH;
+}
+
+// Main thread, the newest snapshot the audio thread has finished
+static const struct audio_snapshot *read_snapshot(struct selector_state *state) {
+	struct snapshot_exchange *exchange = &state->snapshot;
+
+	if(atomic_load_explicit(&exchange->latest, memory_order_relaxed) & SNAPSHOT_FRESH) {
+		exchange->front = atomic_exchange_explicit(&exchange->latest, exchange->front, memory_order_acq_rel) & ~SNAPSHOT_FRESH;
+	}
+	return &exchange->buffers[exchange->front];
+}
+
+/*
+ * The sample that is being heard at timer_now() time now, in clock.samplePos time, to line effects
+ * up with the music. The last mixed sample is heard after the rest of its buffer and whatever the
+ * device already has queued, taken to be one more buffer, so two buffers behind unless
+ * SELECTOR_AUDIO_LATENCY_MS says otherwise. From there the position moves on in real time. It never
+ * goes back or past what was mixed, unless the clock went back because a song was started.
+ */
+static double playing_sample_position(struct selector_state *state, const struct audio_snapshot *audio, uint64_t now) {
+	const pt2Clock_t *clock = &audio->clock;
+	if(clock->audioRate <= 0) {
+		return 0.0;
+	}
+	if((double)clock->samplePos < state->playing_position) {
+		state->playing_position = 0.0;
+	}
+
+#ifdef SELECTOR_AUDIO_LATENCY_MS
+	double latency = SELECTOR_AUDIO_LATENCY_MS * 0.001 * clock->audioRate;
+#else
+	double latency = 2.0 * audio->callback_frames;
+#endif
+	double elapsed = (now > audio->callback_time) ? (now - audio->callback_time) * 1e-9 * clock->audioRate : 0.0;
+	double position = (double)clock->samplePos - latency + elapsed;
+
+	if(position > (double)clock->samplePos) {
+		position = (double)clock->samplePos;
+	}
+	if(position < state->playing_position) {
+		position = state->playing_position;
+	}
+	state->playing_position = position;
+	return position;
+}
+
+static void timing_push(struct timing_ring *ring, uint64_t ns) {
+	ring->ns[ring->next] = (ns < UINT32_MAX) ? (uint32_t)ns : UINT32_MAX;
+	ring->next = (ring->next + 1) % TIMING_SAMPLES;
+	ring->count += (ring->count < TIMING_SAMPLES);
+}
+
+static void timing_add(struct selector_state *state, uint32_t stage, uint64_t start) {
+	state->stage_time[stage] += timer_now() - start;
+	state->stages_run |= 1u << stage;
+}
+
+static int compare_uint32(const void *a, const void *b) {
+	uint32_t x = *(const uint32_t *)a;
+	uint32_t y = *(const uint32_t *)b;
+	return (x > y) - (x < y);
+}
+
+// In nanoseconds, 0 when nothing was timed yet
+static void timing_percentiles(struct timing_ring *ring, uint32_t *p50, uint32_t *p99, uint32_t *max) {
+	uint32_t sorted[TIMING_SAMPLES];
+	uint32_t count = ring->count;		// the ring fills from the start, so the first count are used
+
+	if(count == 0) {
+		*p50 = *p99 = *max = 0;
+		return;
+	}
+	memcpy(sorted, ring->ns, count * sizeof(uint32_t));
+	qsort(sorted, count, sizeof(uint32_t), compare_uint32);
+	*p50 = sorted[count / 2];
+	*p99 = sorted[count * 99 / 100];
+	*max = sorted[count - 1];
+}
+
+static char to_lower(char character) {
+	return (character >= 'A' && character <= 'Z') ? character + ('a' - 'A') : character;
+}
+
+static void build_search_index(struct search_index *index, struct loader_info *remakes, uint32_t remake_count) {
+	uint32_t *seen = (uint32_t *)calloc(256, sizeof(uint32_t));		// remake + 1 that last counted the character
+	uint32_t fill[256];
+	size_t names_size = 0;
+
+	for(uint32_t i = 0; i < remake_count; ++i) {
+		names_size += strlen(remakes[i].display_name) + 1;
+	}
+	index->names = (char *)malloc(names_size + 1);
+	index->name_offsets = (uint32_t *)malloc(remake_count * sizeof(uint32_t) + 1);
+	memset(index->char_start, 0, sizeof(index->char_start));
+
+	char *name = index->names;
+	for(uint32_t i = 0; i < remake_count; ++i) {
+		index->name_offsets[i] = (uint32_t)(name - index->names);
+		for(const char *c = remakes[i].display_name; *c; ++c) {
+			uint8_t character = (uint8_t)to_lower(*c);
+			*name++ = (char)character;
+			if(seen[character] != i + 1) {
+				seen[character] = i + 1;
+				index->char_start[character + 1]++;
+			}
+		}
+		*name++ = 0;
+	}
+
+	for(uint32_t c = 0; c < 256; ++c) {
+		index->char_start[c + 1] += index->char_start[c];
+		fill[c] = index->char_start[c];
+	}
+	index->char_entries = (uint32_t *)malloc(index->char_start[256] * sizeof(uint32_t) + 1);
+
+	memset(seen, 0, 256 * sizeof(uint32_t));
+	for(uint32_t i = 0; i < remake_count; ++i) {
+		for(const uint8_t *c = (const uint8_t *)index->names + index->name_offsets[i]; *c; ++c) {
+			if(seen[*c] != i + 1) {
+				seen[*c] = i + 1;
+				index->char_entries[fill[*c]++] = i;
+			}
+		}
+	}
+	free(seen);
+}
+
+// All fields are in one allocation, freed through stars.x
+static void setup_stars(struct selector_state *state, uint32_t count) {
+	struct starfield *stars = &state->stars;
+	size_t words = (size_t)count * 5;
+
+	stars->count = count;
+	stars->x = (int32_t *)calloc(words * sizeof(uint32_t) + count + 1, 1);
+	stars->speed = stars->x + count;
+	stars->color = (uint32_t *)(stars->speed + count);
+	stars->row_offset = stars->color + count;
+	stars->drawn_offset = stars->row_offset + count;
+	stars->row = (uint8_t *)(stars->drawn_offset + count);
+
+	for(uint32_t i = 0; i < count; ++i) {
+		const struct star_layer *layer = &star_layers[i % STAR_LAYERS];
+		uint32_t row = (uint32_t)((uint64_t)i * STAR_ROWS / count);
+
+		stars->x[i] = (int32_t)(xor_generate_random(&state->rand_state) % state->shared->buffer_width);
+		stars->speed[i] = layer->speed;
+		stars->color[i] = layer->color;
+		stars->row[i] = (uint8_t)row;
+		stars->row_offset[i] = row * state->shared->buffer_width;
+	}
+}
+
 void setup(struct loader_shared_state *state, struct loader_info *remakes, uint32_t remake_count) {
 	state->selector_state = (struct selector_state *)calloc(1, sizeof(struct selector_state));
 	struct selector_state *selector = (struct selector_state *)state->selector_state;
@@ -45,25 +692,304 @@ void setup(struct loader_shared_state *state, struct loader_info *remakes, uint3
 	selector->old_mouse_x = state->mouse_x;
 	selector->old_mouse_y = state->mouse_y;
 
+	select_blitters();
 	pt2play_initPlayer(48000);
-	pt2play_PlaySong(&selector->zeus, zeus_data, CIA_TEMPO_MODE, 48000);
 
-	for(uint32_t i = 0; i < 120; ++i) {
-		selector->star_x[i] = xor_generate_random(&selector->rand_state) % state->buffer_width;
+	const uint8_t *music = zeus_data;
+	selector->music_file = map_file(SELECTOR_MUSIC_FILE, &selector->music_file_size);
+	if(selector->music_file) {
+		if(selector->music_file_size <= UINT32_MAX && pt2play_CheckModule(selector->music_file, (uint32_t)selector->music_file_size)) {
+			music = selector->music_file;
+		} else {
+			unmap_file(selector->music_file, selector->music_file_size);
+			selector->music_file = 0;
+		}
 	}
+	pt2play_PlaySong(&selector->zeus, music, CIA_TEMPO_MODE, 48000);
+	selector->playing_position = 0.0;
+
+	setup_stars(selector, STARFIELD_STARS);
+
+	selector->background = (uint32_t *)calloc(state->buffer_width * state->buffer_height, sizeof(uint32_t));
+	selector->text_mask = (uint8_t *)calloc(state->buffer_width * state->buffer_height, sizeof(uint8_t));
+	selector->list_count = remake_count;
+	selector->snapshot.back = 1;
+	selector->snapshot.front = 2;
+	build_search_index(&selector->search, remakes, remake_count);
+	selector->full_redraw = true;
 }
 
 void cleanup(struct loader_shared_state *state) {
 	struct selector_state *selector = (struct selector_state *)state->selector_state;
-	(void) selector;
+
+#ifdef SELECTOR_TIMING_REPORT
+	printf("%-8s %9s %9s %9s (us, last %u runs)\n", "", "p50", "p99", "max", TIMING_SAMPLES);
+	for(uint32_t i = 0; i < TIMING_COUNT; ++i) {
+		uint32_t p50, p99, max;
+		timing_percentiles(&selector->timings[i], &p50, &p99, &max);
+		printf("%-8s %9.1f %9.1f %9.1f\n", timing_names[i], p50 / 1000.0, p99 / 1000.0, max / 1000.0);
+	}
+#endif
+
+	pt2play_Close(&selector->zeus);
+	if(selector->music_file) {
+		unmap_file(selector->music_file, selector->music_file_size);
+	}
+	free(selector->stars.x);
+	free(selector->background);
+	free(selector->text_mask);
+	for(uint32_t i = 0; i < TEXT_STRIP_CACHE; ++i) {
+		free(selector->text_strips[i].pixels);
+	}
+	free(selector->letter_entries);
+	for(uint32_t i = 2; i <= SEARCH_MAX_LENGTH; ++i) {
+		free(selector->matches[i]);
+	}
+	free(selector->search.names);
+	free(selector->search.name_offsets);
+	free(selector->search.char_entries);
 
 	free(state->selector_state);
 	state->selector_state = 0;
 }
 
+/*
+ * The remake list.
+ *
+ * Only the entries in view are ever looked at, so the cost of a frame doesn't depend on remake_count.
+ * current_y moves in pixels, the list scrolls smoothly with the mouse and settles on the nearest
+ * entry when it's left alone.
+ */
+#define LIST_ROWS 9
+#define LIST_ROW_HEIGHT 8
+
+struct list_view {
+	uint32_t top;					// pixel position of the first visible row in the list
+	uint32_t first_entry;
+	uint32_t line_count;			// one more than the visible rows when the list is between two entries
+	uint32_t bar_y;					// selection bar, in pixels from SELECTION_BAR_FIRST_ROW
+	uint32_t current_entry;
+};
+
+// Entries are positions in the list, list_entry() gives the remake
+static uint32_t list_entry(struct selector_state *state, uint32_t entry) {
+	return state->list_entries ? state->list_entries[entry] : entry;
+}
+
+static uint32_t selected_entry(struct selector_state *state) {
+	uint32_t entry = ((uint32_t)state->current_y + LIST_ROW_HEIGHT / 2) / LIST_ROW_HEIGHT;
+	return (entry < state->list_count) ? entry : state->list_count - 1;
+}
+
+static void select_entry(struct selector_state *state, uint32_t entry) {
+	state->current_y = (int32_t)(entry * LIST_ROW_HEIGHT);
+}
+
+// The selection bar stays in the middle and the list scrolls under it, except at the ends where the bar moves instead
+static void calculate_list_view(struct selector_state *state, struct list_view *view) {
+	uint32_t total_entries = state->list_count;
+	uint32_t visible_entries = (total_entries < LIST_ROWS) ? total_entries : LIST_ROWS;
+	int32_t max_top = (int32_t)((total_entries - visible_entries) * LIST_ROW_HEIGHT);
+	int32_t top = state->current_y - (int32_t)(visible_entries / 2 * LIST_ROW_HEIGHT);
+
+	top = (top < 0) ? 0 : (top > max_top ? max_top : top);
+
+	view->top = (uint32_t)top;
+	view->first_entry = view->top / LIST_ROW_HEIGHT;
+	view->line_count = visible_entries + ((view->top % LIST_ROW_HEIGHT) ? 1 : 0);
+	view->bar_y = (uint32_t)(state->current_y - top);
+	view->current_entry = selected_entry(state);
+}
+
+// 0-9 and A-Z, -1 for everything else
+static int32_t letter_index(uint8_t character) {
+	if(character >= '0' && character <= '9') {
+		return character - '0';
+	}
+	if(character >= 'a' && character <= 'z') {
+		character -= 'a' - 'A';
+	}
+	if(character >= 'A' && character <= 'Z') {
+		return 10 + character - 'A';
+	}
+	return -1;
+}
+
+static void build_letter_index(struct selector_state *state) {
+	uint32_t fill[36] = { 0 };
+
+	state->letter_entries = (uint32_t *)malloc(state->remake_count * sizeof(uint32_t) + 1);
+	memset(state->letter_start, 0, sizeof(state->letter_start));
+
+	for(uint32_t i = 0; i < state->remake_count; ++i) {
+		int32_t letter = letter_index((uint8_t)state->remakes[i].display_name[0]);
+		if(letter >= 0) {
+			state->letter_start[letter + 1]++;
+		}
+	}
+	for(uint32_t i = 0; i < 36; ++i) {
+		state->letter_start[i + 1] += state->letter_start[i];
+		fill[i] = state->letter_start[i];
+	}
+	for(uint32_t i = 0; i < state->remake_count; ++i) {
+		int32_t letter = letter_index((uint8_t)state->remakes[i].display_name[0]);
+		if(letter >= 0) {
+			state->letter_entries[fill[letter]++] = i;
+		}
+	}
+}
+
+// Selects the next entry starting with the letter, wrapping around to the first one. Only used when the list isn't filtered.
+static void jump_to_letter(struct selector_state *state, int32_t letter) {
+	if(!state->letter_entries) {
+		build_letter_index(state);
+	}
+
+	uint32_t first = state->letter_start[letter];
+	uint32_t last = state->letter_start[letter + 1];
+	if(first == last) {
+		return;
+	}
+
+	uint32_t current_entry = selected_entry(state);
+	uint32_t low = first;
+	uint32_t high = last;
+	while(low < high) {
+		uint32_t middle = low + (high - low) / 2;
+		if(state->letter_entries[middle] <= current_entry) {
+			low = middle + 1;
+		} else {
+			high = middle;
+		}
+	}
+	select_entry(state, state->letter_entries[(low < last) ? low : first]);
+}
+
+/*
+ * Type-ahead search, TAB starts and ends it.
+ *
+ * The remakes matching the first character come straight from the index, every character after
+ * that only looks at the remakes that matched before it. The result of each length is kept so
+ * BACKSPACE is free.
+ */
+static void set_list(struct selector_state *state, uint32_t *entries, uint32_t count) {
+	state->list_entries = entries;
+	state->list_count = entries ? count : state->remake_count;
+	state->list_changed = true;
+	select_entry(state, 0);
+}
+
+static void search_append(struct selector_state *state, char character) {
+	if(state->query_length == SEARCH_MAX_LENGTH) {
+		return;
+	}
+
+	uint32_t length = ++state->query_length;
+	state->query[length - 1] = character;
+	state->query[length] = 0;
+
+	if(length == 1) {
+		uint8_t c = (uint8_t)character;
+		state->matches[1] = state->search.char_entries + state->search.char_start[c];
+		state->match_count[1] = state->search.char_start[c + 1] - state->search.char_start[c];
+	} else {
+		uint32_t *previous = state->matches[length - 1];
+		uint32_t previous_count = state->match_count[length - 1];
+		uint32_t count = 0;
+
+		state->matches[length] = (uint32_t *)realloc(state->matches[length], previous_count * sizeof(uint32_t) + 1);
+		for(uint32_t i = 0; i < previous_count; ++i) {
+			if(strstr(state->search.names + state->search.name_offsets[previous[i]], state->query)) {
+				state->matches[length][count++] = previous[i];
+			}
+		}
+		state->match_count[length] = count;
+	}
+	set_list(state, state->matches[length], state->match_count[length]);
+}
+
+static void search_backspace(struct selector_state *state) {
+	if(state->query_length == 0) {
+		return;
+	}
+
+	uint32_t length = --state->query_length;
+	state->query[length] = 0;
+	set_list(state, state->matches[length], state->match_count[length]);
+}
+
+// Leaving the search keeps the selected remake selected
+static void search_end(struct selector_state *state) {
+	uint32_t remake = state->list_count ? list_entry(state, selected_entry(state)) : 0;
+
+	state->searching = false;
+	state->query_length = 0;
+	state->query[0] = 0;
+	set_list(state, 0, 0);
+	select_entry(state, remake);
+}
+
 void key_callback(struct selector_state *state, int key, int action) {
-	(void) state;
-	(void) key;
+	if(action == 0 || state->remake_count == 0) {		// key release
+		return;
+	}
+
+	if(key == REMAKE_KEY_F1) {
+		state->show_timings = !state->show_timings;
+		state->timings_changed = true;
+		return;
+	}
+
+	if(key == REMAKE_KEY_F2) {
+		state->music_paused = !state->music_paused;
+		send_audio_command(state, AUDIO_PAUSE, state->music_paused);
+		return;
+	}
+
+	if(key == REMAKE_KEY_TAB) {
+		if(state->searching) {
+			search_end(state);
+		} else {
+			state->searching = true;
+			state->list_changed = true;
+		}
+		return;
+	}
+
+	if(state->searching) {
+		if(key >= REMAKE_KEY_A && key <= REMAKE_KEY_Z) {
+			search_append(state, 'a' + (key - REMAKE_KEY_A));
+		} else if(key >= REMAKE_KEY_0 && key <= REMAKE_KEY_9) {
+			search_append(state, '0' + (key - REMAKE_KEY_0));
+		} else if(key == REMAKE_KEY_SPACE) {
+			search_append(state, ' ');
+		} else if(key == REMAKE_KEY_BACKSPACE) {
+			search_backspace(state);
+		}
+	}
+
+	if(state->list_count == 0) {
+		return;
+	}
+
+	uint32_t current_entry = selected_entry(state);
+	uint32_t last_entry = state->list_count - 1;
+
+	if(key == REMAKE_KEY_PAGE_UP) {
+		select_entry(state, (current_entry > LIST_ROWS) ? current_entry - LIST_ROWS : 0);
+	} else if(key == REMAKE_KEY_PAGE_DOWN) {
+		select_entry(state, (last_entry - current_entry > LIST_ROWS) ? current_entry + LIST_ROWS : last_entry);
+	} else if(key == REMAKE_KEY_HOME) {
+		select_entry(state, 0);
+	} else if(key == REMAKE_KEY_END) {
+		select_entry(state, last_entry);
+	} else if(state->searching) {
+		return;
+	} else if(key >= REMAKE_KEY_0 && key <= REMAKE_KEY_9) {
+		jump_to_letter(state, key - REMAKE_KEY_0);
+	} else if(key >= REMAKE_KEY_A && key <= REMAKE_KEY_Z) {
+		jump_to_letter(state, 10 + key - REMAKE_KEY_A);
+	}
 }
 
 void pre_selector_run(struct selector_state *state) {
@@ -71,93 +997,233 @@ void pre_selector_run(struct selector_state *state) {
 }
 
 void audio_callback(struct selector_state *state, int16_t *audio_buffer, size_t frames) {
-	(void) state;
+	uint64_t start = timer_now();
+
+	struct audio_command command;
+	while(spsc_pop(&state->command_queue, state->commands, sizeof(command), &command)) {
+		run_audio_command(state, &command);
+	}
+
+	state->zeus.tickTime = 0;
+	state->zeus.mixTime = 0;
 	pt2play_FillAudioBuffer(&state->zeus, audio_buffer, frames);
-}
 
-void calculate_lineposition_and_entry(uint32_t current_position, uint32_t total_entries, uint32_t visible_entries, uint32_t *first_row, uint32_t *selection_row, uint32_t *current_entry) {
-	const uint32_t half_visible = visible_entries / 2;
-	const uint32_t last_visible_index = visible_entries - 1;
+	publish_snapshot(state, (uint32_t)frames);
+
+	struct audio_timing timing = { .total = timer_now() - start, .tick = state->zeus.tickTime, .mix = state->zeus.mixTime };
+	spsc_push(&state->timing_queue, state->audio_timings, sizeof(timing), &timing);
+}
 
-	// Direct Calculation with Edge Case Handling
-	*first_row = (current_position > half_visible && total_entries > visible_entries) ?
-					 (current_position < total_entries - half_visible ? current_position - half_visible : total_entries - visible_entries) :
-					 0;
+#define LIST_END_ROW (78 + 8*9 + 3)		// the lower copper line
 
-	*selection_row = current_position - *first_row;
+static void restore_stars(struct selector_state *state) {
+	struct starfield *stars = &state->stars;
+	uint32_t *buffer = state->shared->buffer + STAR_FIRST_ROW * state->shared->buffer_width;
+	uint32_t *background = state->background + STAR_FIRST_ROW * state->shared->buffer_width;
 
-	// Combine and Clamp in One Step
-	*current_entry = (*first_row + *selection_row < total_entries) ? *first_row + *selection_row : total_entries - 1;
-	*selection_row = (*selection_row < visible_entries) ? *selection_row : last_visible_index;
+	for(uint32_t i = 0; i < stars->count; ++i) {
+		uint32_t offset = stars->drawn_offset[i];
+		buffer[offset] = background[offset];
+	}
 }
 
-static void render_stars(struct selector_state *state) {
-    uint32_t *buffer_base = state->shared->buffer + 79 * state->shared->buffer_width;
-    uint32_t star_colors[] = {0x444444ff, 0x777777ff, 0xaaaaaaff, 0xffffffff};
+// Stars are behind the selection bar and the text
+static void render_stars(struct selector_state *state, uint32_t bar_y) {
+	struct starfield *stars = &state->stars;
+	uint32_t *buffer_base = state->shared->buffer + STAR_FIRST_ROW * state->shared->buffer_width;
+	uint8_t *mask_base = state->text_mask + STAR_FIRST_ROW * state->shared->buffer_width;
+	uint32_t bar_first = SELECTION_BAR_FIRST_ROW + bar_y - STAR_FIRST_ROW;
 
-    // Loop unrolling for 8 rows (with one star per row)
-    for (uint32_t row = 0; row < 8*9; row++) {
-        uint32_t *dst = buffer_base + row * state->shared->buffer_width + state->star_x[row];
-        *dst = star_colors[row % 4];  // Color based on row
+	for(uint32_t i = 0; i < stars->count; ++i) {
+		uint32_t offset = stars->row_offset[i] + (uint32_t)stars->x[i];
+		if((uint32_t)stars->row[i] - bar_first >= 8 && !mask_base[offset]) {
+			buffer_base[offset] = stars->color[i];
+		}
+		stars->drawn_offset[i] = offset;
+	}
 
-        // Update star position with ternary operator
-        state->star_x[row] = (state->star_x[row] -= (row & 3) + 1) > state->shared->buffer_width
-                              ? state->star_x[row] + state->shared->buffer_width
-                              : state->star_x[row];
-    }
+	scroll_stars(stars->x, stars->speed, stars->count, (int32_t)state->shared->buffer_width);
 }
 
-static void render_copper_line(struct selector_state *state, uint32_t row) {
+/*
+ * Copper bars, a color for each scanline the way the Amiga copper changes a color register on a
+ * raster line. The copper list is drawn into the background on a full redraw, the selection bar is
+ * a bar of its own that moves with the selection.
+ */
+struct copper_bar {
+	uint32_t row;					// first row, the selection bar is placed by render_selectionbar()
+	uint32_t height;
+	const uint32_t *colors;			// one per row
+};
+
+static const uint32_t copper_line_colors[] = { 0x990000ff };
+static const uint32_t selection_bar_colors[] = { 0x00660000, 0x00440000, 0x00550000, 0x00660000, 0x00550000, 0x00440000, 0x00330000, 0x00770000 };
+
+static const struct copper_bar copper_list[] = {
+	{ 78, 1, copper_line_colors },
+	{ LIST_END_ROW, 1, copper_line_colors },
+};
+
+static const struct copper_bar selection_bar = { 0, 8, selection_bar_colors };
+
+static void render_copper_bar(struct selector_state *state, uint32_t *buffer, const struct copper_bar *bar, uint32_t row) {
+	uint32_t buffer_width = state->shared->buffer_width;
+	uint32_t *dst = buffer + row * buffer_width;
+
+	for(uint32_t i = 0; i < bar->height && row + i < state->shared->buffer_height; ++i, dst += buffer_width) {
+		fill_span(dst, bar->colors[i], buffer_width);
+	}
+}
 
-	uint32_t *dst = state->shared->buffer + row * state->shared->buffer_width;
-	for(uint32_t i = 0; i < state->shared->buffer_width; ++i) {
-		dst[i] = 0x990000ff;
+static void render_copper_list(struct selector_state *state, uint32_t *buffer) {
+	for(uint32_t i = 0; i < sizeof(copper_list) / sizeof(copper_list[0]); ++i) {
+		render_copper_bar(state, buffer, &copper_list[i], copper_list[i].row);
 	}
 }
 
-void render_text(struct loader_info *remakes, uint32_t line_count, uint32_t first_line, uint32_t *buffer, uint32_t buffer_width) {
-	const uint32_t stride = buffer_width;
+// The strip of a line of the list, 0 if there is no memory for it
+static struct text_strip *get_text_strip(struct selector_state *state, uint32_t line) {
+	uint32_t entry = list_entry(state, line);
+	struct text_strip *strip = &state->text_strips[line % TEXT_STRIP_CACHE];
+	if(strip->entry == entry + 1) {
+		return strip;
+	}
+
+	uint8_t *name = (uint8_t *)state->remakes[entry].display_name;
+	uint32_t width = strlen((char *)name) * 8;
+	size_t size = width * 8 * (sizeof(uint32_t) + sizeof(uint8_t)) + 1;
+	if(size > strip->size) {
+		free(strip->pixels);
+		strip->pixels = (uint32_t *)malloc(size);
+		if(!strip->pixels) {
+			strip->size = 0;
+			strip->entry = 0;
+			return 0;
+		}
+		strip->size = size;
+	}
+	memset(strip->pixels, 0, size);
+	strip->width = width;
+	strip->mask = (uint8_t *)(strip->pixels + width * 8);
+	strip->entry = entry + 1;
+
+	for(uint32_t x_offset = 0; *name; x_offset += 8) {
+		uint8_t character = *name++;
+		uint8_t *sprite = ddr_tiny_small8x8_data + ((character - 0x20) * 8 * 8);
+
+		for(uint32_t y = 0; y < 8; ++y) {
+			blit_glyph_row(strip->pixels + y * strip->width + x_offset, sprite, ddr_tiny_small8x8_palette);
+			for(uint32_t x = 0; x < 8; ++x) {
+				strip->mask[y * strip->width + x_offset + x] = (sprite[x] != 0);
+			}
+			sprite += 8;
+		}
+	}
+	return strip;
+}
 
-	for (uint32_t i = 0; i < line_count; ++i) {
-		uint8_t *current_line = (uint8_t *)remakes[i + first_line].display_name;
-		uint32_t y_offset = 81 * buffer_width + (i * 8 * buffer_width);
-		uint32_t x_offset = 34;
+// Lines are 8 pixels apart from pixel row y, rows outside the list are clipped away
+void render_text(struct selector_state *state, uint32_t line_count, uint32_t first_line, int32_t y, uint32_t *buffer, uint8_t *mask, uint32_t buffer_width) {
+	const uint32_t x_offset = 34;
 
-		while (*current_line) {
-			uint8_t character = *current_line++;
-			uint8_t *sprite = ddr_tiny_small8x8_data + ((character - 0x20) * 8 * 8);
-			uint32_t *dest = buffer + x_offset + y_offset;
+	for (uint32_t i = 0; i < line_count; ++i, y += 8) {
+		struct text_strip *strip = get_text_strip(state, i + first_line);
+		if(!strip) {
+			continue;
+		}
+		uint32_t width = (strip->width < buffer_width - x_offset) ? strip->width : buffer_width - x_offset;
 
-			// Unrolled loop with transparency check
-			for (uint32_t y = 0; y < 8; ++y) {
-				dest[0] = sprite[0] ? ddr_tiny_small8x8_palette[sprite[0]] : dest[0];
-				dest[1] = sprite[1] ? ddr_tiny_small8x8_palette[sprite[1]] : dest[1];
-				dest[2] = sprite[2] ? ddr_tiny_small8x8_palette[sprite[2]] : dest[2];
-				dest[3] = sprite[3] ? ddr_tiny_small8x8_palette[sprite[3]] : dest[3];
-				dest[4] = sprite[4] ? ddr_tiny_small8x8_palette[sprite[4]] : dest[4];
-				dest[5] = sprite[5] ? ddr_tiny_small8x8_palette[sprite[5]] : dest[5];
-				dest[6] = sprite[6] ? ddr_tiny_small8x8_palette[sprite[6]] : dest[6];
-				dest[7] = sprite[7] ? ddr_tiny_small8x8_palette[sprite[7]] : dest[7];
-				dest += stride;
-				sprite += 8;
+		// Masked row copy, glyph pixels overwrite and the rest is left alone
+		for (int32_t row = 0; row < 8; ++row) {
+			if(y + row < STAR_FIRST_ROW || y + row >= LIST_END_ROW) {
+				continue;
 			}
-			x_offset += 8;
+			uint32_t offset = (uint32_t)(y + row) * buffer_width + x_offset;
+			blit_masked_row(buffer + offset, mask + offset, strip->pixels + row * strip->width, strip->mask + row * strip->width, width);
 		}
 	}
 }
 
 
-void render_selectionbar(struct selector_state *state, uint32_t selection_row) {
-	uint32_t select_color_bar[] = { 0x00660000, 0x00440000, 0x00550000, 0x00660000, 0x00550000, 0x00440000, 0x00330000, 0x00770000 };
-	uint32_t *s = state->shared->buffer + (selection_row * 8) * state->shared->buffer_width + 80 * state->shared->buffer_width;
-	for(uint32_t i = 0; i < 8; ++i) {
-		uint32_t col = select_color_bar[i];
-		for(uint32_t j = 0; j < state->shared->buffer_width; ++j) {
-			*s++ = col;
+void render_selectionbar(struct selector_state *state, uint32_t *buffer, uint32_t bar_y) {
+	render_copper_bar(state, buffer, &selection_bar, SELECTION_BAR_FIRST_ROW + bar_y);
+}
+
+// Redraws the part of the background between the copper lines
+static void render_background(struct selector_state *state, struct list_view *view) {
+	uint32_t first = (STAR_FIRST_ROW) * state->shared->buffer_width;
+	uint32_t count = (LIST_END_ROW - STAR_FIRST_ROW) * state->shared->buffer_width;
+	int32_t text_y = SELECTION_BAR_FIRST_ROW + 1 - (int32_t)(view->top % LIST_ROW_HEIGHT);
+
+	uint64_t start = timer_now();
+	memset(state->background + first, 0, count * sizeof(uint32_t));
+	memset(state->text_mask + first, 0, count * sizeof(uint8_t));
+	timing_add(state, TIMING_CLEAR, start);
+
+	start = timer_now();
+	render_selectionbar(state, state->background, view->bar_y);
+	timing_add(state, TIMING_SELECTION_BAR, start);
+
+	start = timer_now();
+	render_text(state, view->line_count, view->first_entry, text_y, state->background, state->text_mask, state->shared->buffer_width);
+	timing_add(state, TIMING_TEXT, start);
+}
+
+static void copy_background_rows(struct selector_state *state, uint32_t first_row, uint32_t row_count) {
+	uint64_t start = timer_now();
+	uint32_t offset = first_row * state->shared->buffer_width;
+	memcpy(state->shared->buffer + offset, state->background + offset, row_count * state->shared->buffer_width * sizeof(uint32_t));
+	timing_add(state, TIMING_COPY, start);
+}
+
+// One line of text straight into the background, cut at the right edge
+static void render_string(struct selector_state *state, uint32_t row, const char *text) {
+	const uint32_t x_offset = 34;
+	uint32_t buffer_width = state->shared->buffer_width;
+	uint32_t *dest = state->background + row * buffer_width + x_offset;
+
+	for(uint32_t i = 0; text[i] && x_offset + (i + 1) * 8 <= buffer_width; ++i) {
+		uint8_t *sprite = ddr_tiny_small8x8_data + ((text[i] - 0x20) * 8 * 8);
+		for(uint32_t y = 0; y < 8; ++y) {
+			blit_glyph_row(dest + y * buffer_width + i * 8, sprite + y * 8, ddr_tiny_small8x8_palette);
 		}
 	}
 }
 
+// The query below the list while searching, the rows are cleared otherwise
+#define SEARCH_ROW 164
+static void render_search_line(struct selector_state *state) {
+	memset(state->background + SEARCH_ROW * state->shared->buffer_width, 0, 8 * state->shared->buffer_width * sizeof(uint32_t));
+	if(state->searching) {
+		char line[sizeof("search: ") + SEARCH_MAX_LENGTH + 1];
+		snprintf(line, sizeof(line), "search: %s_", state->query);
+		render_string(state, SEARCH_ROW, line);
+	}
+	copy_background_rows(state, SEARCH_ROW, 8);
+}
+
+// The timing overlay below the search line, in microseconds
+#define TIMING_ROW 172
+static void render_timings(struct selector_state *state) {
+	uint32_t row_count = (TIMING_COUNT + 1) * 8;
+
+	memset(state->background + TIMING_ROW * state->shared->buffer_width, 0, row_count * state->shared->buffer_width * sizeof(uint32_t));
+	if(state->show_timings) {
+		const struct audio_snapshot *audio = read_snapshot(state);
+		char line[64];
+		snprintf(line, sizeof(line), "%-6s %8s %8s %8s  %02u:%02u", "us", "p50", "p99", "max", audio->clock.songPosition, audio->clock.row);
+		render_string(state, TIMING_ROW, line);
+
+		for(uint32_t i = 0; i < TIMING_COUNT; ++i) {
+			uint32_t p50, p99, max;
+			timing_percentiles(&state->timings[i], &p50, &p99, &max);
+			snprintf(line, sizeof(line), "%-6s %8.1f %8.1f %8.1f", timing_names[i], p50 / 1000.0, p99 / 1000.0, max / 1000.0);
+			render_string(state, TIMING_ROW + (i + 1) * 8, line);
+		}
+	}
+	copy_background_rows(state, TIMING_ROW, row_count);
+}
+
 /*
  * ESCAPE is used globally to exit everything.
  *
@@ -165,7 +1231,26 @@ void render_selectionbar(struct selector_state *state, uint32_t selection_row) {
  */
 const uint32_t SPEED_DIVISOR = 8;
 uint32_t mainloop_callback(struct selector_state *state) {
-	memset(state->shared->buffer, 0, state->shared->buffer_height * state->shared->buffer_width * sizeof(uint32_t));
+	uint64_t frame_start = timer_now();
+	if(state->frame_start) {
+		timing_push(&state->timings[TIMING_INTERVAL], frame_start - state->frame_start);
+	}
+	state->frame_start = frame_start;
+	memset(state->stage_time, 0, sizeof(state->stage_time));
+	state->stages_run = 1u << TIMING_FRAME;
+
+	struct audio_timing audio_timing;
+	while(spsc_pop(&state->timing_queue, state->audio_timings, sizeof(audio_timing), &audio_timing)) {
+		timing_push(&state->timings[TIMING_AUDIO], audio_timing.total);
+		timing_push(&state->timings[TIMING_AUDIO_TICK], audio_timing.tick);
+		timing_push(&state->timings[TIMING_AUDIO_MIX], audio_timing.mix);
+	}
+
+	const struct audio_snapshot *audio = read_snapshot(state);
+	if(audio->clock.audioRate > 0) {
+		double delay = (double)audio->clock.samplePos - playing_sample_position(state, audio, frame_start);
+		timing_push(&state->timings[TIMING_DELAY], (uint64_t)(delay * 1e9 / audio->clock.audioRate));
+	}
 
 	// Update selector->old_mouse_y and adjust current_y based on mouse movement
 	int32_t mouse_delta = state->shared->mouse_y - state->old_mouse_y;
@@ -173,35 +1258,87 @@ uint32_t mainloop_callback(struct selector_state *state) {
 	state->current_y += mouse_delta;
 
 	// Update selector current_y with keyboard, just in case someone doesn't like the mouse.
+	bool moved = (mouse_delta != 0);
 	if(state->shared->keyboard_state[REMAKE_KEY_UP]) {
 		state->current_y -= SPEED_DIVISOR;
+		moved = true;
 	}
 	if(state->shared->keyboard_state[REMAKE_KEY_DOWN]) {
 		state->current_y += SPEED_DIVISOR;
+		moved = true;
+	}
+
+	// Settle on the nearest entry when nothing is moving the list, current_y is still clamped from the last frame then
+	int32_t sub_row = state->current_y % LIST_ROW_HEIGHT;
+	if(!moved && sub_row) {
+		state->current_y += (sub_row < LIST_ROW_HEIGHT / 2) ? -1 : 1;
 	}
 
-	// Retrieve max_entry and clamp selector->current_y within bounds
-	uint32_t max_entry = state->remake_count;
-	int32_t max_y = (int32_t)(max_entry * SPEED_DIVISOR);
+	// Clamp selector->current_y to the last entry
+	int32_t max_y = state->list_count ? (int32_t)((state->list_count - 1) * LIST_ROW_HEIGHT) : 0;
 	state->current_y = (state->current_y < 0) ? 0 : (state->current_y > max_y ? max_y : state->current_y);
 
-	// Calculate visible_entries (no casts needed since max_entry is uint32_t)
-	uint32_t visible_entries = (max_entry < 9) ? max_entry : 9;
+	struct list_view view;
+	calculate_list_view(state, &view);
+
+	// Render graphics and text, only what changed since the last frame is written to the frame buffer
+	if(state->full_redraw) {
+		uint64_t start = timer_now();
+		memset(state->background, 0, state->shared->buffer_height * state->shared->buffer_width * sizeof(uint32_t));
+		timing_add(state, TIMING_CLEAR, start);
+
+		start = timer_now();
+		render_copper_list(state, state->background);
+		timing_add(state, TIMING_COPPER, start);
 
-	// Calculate line position and entry
-	uint32_t first_entry, selection_row, current_entry;
-	calculate_lineposition_and_entry((uint32_t)state->current_y / SPEED_DIVISOR, max_entry, visible_entries, &first_entry, &selection_row, &current_entry);
+		render_background(state, &view);
+		copy_background_rows(state, 0, state->shared->buffer_height);
+		state->full_redraw = false;
+	} else {
+		uint64_t start = timer_now();
+		restore_stars(state);
+		timing_add(state, TIMING_STARS, start);
 
-	// Render graphics and text
-	render_copper_line(state, 78);
-	render_stars(state);
-	render_selectionbar(state, selection_row);
-	render_text(state->remakes, visible_entries, first_entry, state->shared->buffer, state->shared->buffer_width);
-	render_copper_line(state, 78 + 8*9 + 3);
+		if(view.top != state->drawn_top || state->list_changed) {
+			render_background(state, &view);
+			copy_background_rows(state, STAR_FIRST_ROW, LIST_END_ROW - STAR_FIRST_ROW);
+		} else if(view.bar_y != state->drawn_bar_y) {
+			render_background(state, &view);
+			copy_background_rows(state, SELECTION_BAR_FIRST_ROW + state->drawn_bar_y, 8);
+			copy_background_rows(state, SELECTION_BAR_FIRST_ROW + view.bar_y, 8);
+		}
+	}
+	if(state->list_changed) {
+		render_search_line(state);
+	}
+	state->drawn_top = view.top;
+	state->drawn_bar_y = view.bar_y;
+	state->list_changed = false;
+
+	uint64_t start = timer_now();
+	render_stars(state, view.bar_y);
+	timing_add(state, TIMING_STARS, start);
+
+	// The overlay is only updated twice a second, the percentiles aren't free
+	if(state->timings_changed || (state->show_timings && state->frame_count % 25 == 0)) {
+		render_timings(state);
+		state->timings_changed = false;
+	}
+	state->frame_count++;
+
+	state->stage_time[TIMING_FRAME] = timer_now() - frame_start;
+	for(uint32_t i = TIMING_FRAME; i <= TIMING_STARS; ++i) {
+		if(state->stages_run & (1u << i)) {
+			timing_push(&state->timings[i], state->stage_time[i]);
+		}
+	}
 
 	// Handle Enter key and Mouse Button input
 	if(state->shared->mouse_button_state[REMAKE_MOUSE_BUTTON_LEFT] | state->shared->keyboard_state[REMAKE_KEY_ENTER]) {
-		return (current_entry << 8) | 1; // Use bitwise OR instead of addition
+		if(state->list_entries && state->list_count == 0) {		// nothing matches the search
+			return 0;
+		}
+		return (list_entry(state, view.current_entry) << 8) | 1; // Use bitwise OR instead of addition
 	}
 
 	return 0;